@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <obs-module.h>
+#include <util/threading.h>
+#include "plugin-macros.generated.h"
+#include "audio-ring.h"
+
+#define CACHELINE_SIZE 64
+
+struct audio_ring_slot
+{
+	uint64_t timestamp;
+	uint32_t frames;
+};
+
+struct audio_ring_s
+{
+	// Immutable after creation
+	size_t planes;
+	size_t frame_bytes;
+	uint32_t slot_frames;
+	uint32_t sample_rate;
+	long n_slots;
+	uint8_t *samples;
+	struct audio_ring_slot *slots;
+	char pad[CACHELINE_SIZE];
+
+	// Producer side. Padded so that the consumer's index does not share the cache line.
+	struct
+	{
+		volatile long write_idx;
+		volatile long overruns;
+		char pad[CACHELINE_SIZE];
+	} prod;
+
+	// Consumer side
+	struct
+	{
+		volatile long read_idx;
+		char pad[CACHELINE_SIZE];
+	} cons;
+};
+
+audio_ring_t *audio_ring_create(size_t planes, size_t frame_bytes, uint32_t sample_rate, uint32_t slot_frames,
+				long n_slots)
+{
+	if (planes > MAX_AV_PLANES || !frame_bytes || !sample_rate || !slot_frames || n_slots < 2)
+		return NULL;
+
+	audio_ring_t *r = bzalloc(sizeof(struct audio_ring_s));
+	r->planes = planes;
+	r->frame_bytes = frame_bytes;
+	r->slot_frames = slot_frames;
+	r->sample_rate = sample_rate;
+	r->n_slots = n_slots;
+	r->samples = bmalloc(frame_bytes * planes * slot_frames * n_slots);
+	r->slots = bzalloc(sizeof(struct audio_ring_slot) * n_slots);
+
+	return r;
+}
+
+void audio_ring_destroy(audio_ring_t *r)
+{
+	if (!r)
+		return;
+
+	bfree(r->samples);
+	bfree(r->slots);
+	bfree(r);
+}
+
+static inline uint8_t *slot_plane(const audio_ring_t *r, long idx, size_t plane)
+{
+	return r->samples + ((size_t)idx * r->planes + plane) * r->slot_frames * r->frame_bytes;
+}
+
+static inline long next_idx(const audio_ring_t *r, long idx)
+{
+	return idx + 1 < r->n_slots ? idx + 1 : 0;
+}
+
+bool audio_ring_push(audio_ring_t *r, const uint8_t *const *data, uint32_t frames, uint64_t timestamp)
+{
+	long w = os_atomic_load_long(&r->prod.write_idx);
+	uint32_t offset = 0;
+
+	while (offset < frames) {
+		long w_next = next_idx(r, w);
+		if (w_next == os_atomic_load_long(&r->cons.read_idx)) {
+			os_atomic_inc_long(&r->prod.overruns);
+			return false;
+		}
+
+		uint32_t n = frames - offset;
+		if (n > r->slot_frames)
+			n = r->slot_frames;
+
+		for (size_t i = 0; i < r->planes; i++)
+			memcpy(slot_plane(r, w, i), data[i] + offset * r->frame_bytes, r->frame_bytes * n);
+
+		struct audio_ring_slot *slot = r->slots + w;
+		slot->frames = n;
+		slot->timestamp = timestamp + (uint64_t)offset * 1000000000 / r->sample_rate;
+
+		offset += n;
+		w = w_next;
+
+		// Publish the slot only after the samples are written.
+		os_atomic_set_long(&r->prod.write_idx, w);
+	}
+
+	return true;
+}
+
+bool audio_ring_peek(audio_ring_t *r, struct audio_data *pkt)
+{
+	long rd = os_atomic_load_long(&r->cons.read_idx);
+	if (rd == os_atomic_load_long(&r->prod.write_idx))
+		return false;
+
+	const struct audio_ring_slot *slot = r->slots + rd;
+	pkt->frames = slot->frames;
+	pkt->timestamp = slot->timestamp;
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		pkt->data[i] = i < r->planes ? slot_plane(r, rd, i) : NULL;
+
+	return true;
+}
+
+void audio_ring_pop(audio_ring_t *r)
+{
+	long rd = os_atomic_load_long(&r->cons.read_idx);
+	if (rd == os_atomic_load_long(&r->prod.write_idx))
+		return;
+
+	os_atomic_set_long(&r->cons.read_idx, next_idx(r, rd));
+}
+
+bool audio_ring_empty(const audio_ring_t *r)
+{
+	return os_atomic_load_long(&r->cons.read_idx) == os_atomic_load_long(&r->prod.write_idx);
+}
+
+uint64_t audio_ring_queued_frames(const audio_ring_t *r)
+{
+	long w = os_atomic_load_long(&r->prod.write_idx);
+	uint64_t frames = 0;
+	for (long i = os_atomic_load_long(&r->cons.read_idx); i != w; i = next_idx(r, i))
+		frames += r->slots[i].frames;
+	return frames;
+}
+
+long audio_ring_overruns(const audio_ring_t *r)
+{
+	return os_atomic_load_long(&r->prod.overruns);
+}
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Single-producer/single-consumer ring of audio.
+ *
+ * The ring consists of a fixed number of slots. Each slot holds up to
+ * `slot_frames` frames of each plane and the timestamp of its first frame.
+ * Planar float audio has one plane of 4-byte frames for each channel, and
+ * interleaved audio has one plane whose frame holds all channels.
+ * All memory is allocated by `audio_ring_create` so that the producer, which
+ * runs on the audio thread of OBS Studio, neither allocates memory nor takes
+ * a mutex.
+ */
+
+struct audio_data;
+typedef struct audio_ring_s audio_ring_t;
+
+/**
+ * Create a ring.
+ * @param[in] planes       Number of planes, up to `MAX_AV_PLANES`.
+ * @param[in] frame_bytes  Size of one frame of each plane in bytes.
+ * @param[in] sample_rate  Sample rate, used to calculate the timestamp of split frames.
+ * @param[in] slot_frames  Maximum number of frames stored in one slot.
+ * @param[in] n_slots      Number of slots. One slot is always kept empty.
+ * @return                 The ring.
+ */
+audio_ring_t *audio_ring_create(size_t planes, size_t frame_bytes, uint32_t sample_rate, uint32_t slot_frames,
+				long n_slots);
+
+/**
+ * Destroy the ring.
+ * @param[in] r  The ring.
+ *
+ * Neither the producer nor the consumer may access the ring at this point.
+ */
+void audio_ring_destroy(audio_ring_t *r);
+
+/**
+ * Push audio frames. Only the producer can call this function.
+ * @param[in] r          The ring.
+ * @param[in] data       Data of each plane.
+ * @param[in] frames     Number of frames.
+ * @param[in] timestamp  Timestamp of the first frame in nanoseconds.
+ * @return               False if the ring was full and some frames were dropped.
+ *
+ * If `frames` exceeds the slot size, the frames are split into several slots.
+ */
+bool audio_ring_push(audio_ring_t *r, const uint8_t *const *data, uint32_t frames, uint64_t timestamp);
+
+/**
+ * Peek the oldest slot. Only the consumer can call this function.
+ * @param[in] r     The ring.
+ * @param[out] pkt  Filled with the pointers to the slot, the number of frames, and the timestamp.
+ * @return          False if the ring is empty.
+ *
+ * The pointers stay valid until `audio_ring_pop` is called.
+ */
+bool audio_ring_peek(audio_ring_t *r, struct audio_data *pkt);
+
+/**
+ * Release the oldest slot returned by `audio_ring_peek`. Only the consumer can call this function.
+ * @param[in] r  The ring.
+ */
+void audio_ring_pop(audio_ring_t *r);
+
+/**
+ * Check whether all pushed frames have been released by the consumer.
+ * @param[in] r  The ring.
+ * @return       True if the ring is empty.
+ */
+bool audio_ring_empty(const audio_ring_t *r);
+
+/**
+ * Get the number of frames waiting in the ring. Only the consumer can call this function.
+ * @param[in] r  The ring.
+ * @return       The number of frames including the slot returned by `audio_ring_peek`.
+ */
+uint64_t audio_ring_queued_frames(const audio_ring_t *r);
+
+/**
+ * Get the number of chunks that could not be pushed because the ring was full.
+ * @param[in] r  The ring.
+ */
+long audio_ring_overruns(const audio_ring_t *r);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
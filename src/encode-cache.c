@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <obs-module.h>
+#include <util/threading.h>
+#include <util/darray.h>
+#include "plugin-macros.generated.h"
+#include "vban.h"
+#include "vban-encode.h"
+#include "encode-cache.h"
+
+/* Number of encoded ticks kept for subscribers that are late. */
+#define ENCODE_CACHE_TICKS 16
+
+/* If a tick is older than the newest one by more than this, the timestamps went back, e.g. when libobs reset the
+ * audio timing, and the entry starts over instead of leaving every subscriber to encode by itself. */
+#define ENCODE_CACHE_RESTART_NS (500 * 1000000ULL)
+
+struct encoded_tick
+{
+	bool valid;
+	uint64_t timestamp;
+	uint32_t frames;
+	struct darray data;
+};
+
+struct encode_cache_s
+{
+	struct encode_cache_key key;
+
+	// instances
+	encode_cache_t *next;
+	encode_cache_t **prev_next;
+	volatile long refcnt;
+
+	pthread_mutex_t mutex;
+	vban_encode_resampler_t *resampler;
+	struct vban_encoder_s encoder;
+	struct encoded_tick ticks[ENCODE_CACHE_TICKS];
+	size_t next_tick;
+	bool has_last;
+	uint64_t last_ts;
+
+	// statistics
+	uint64_t cnt_encoded;
+	uint64_t cnt_shared;
+	uint64_t cnt_missed;
+	uint64_t cnt_restarts;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static encode_cache_t *entries = NULL;
+
+static encode_cache_t *encode_cache_get_ref(encode_cache_t *c)
+{
+	long owners = os_atomic_load_long(&c->refcnt);
+	while (owners > -1) {
+		if (os_atomic_compare_exchange_long(&c->refcnt, &owners, owners + 1))
+			return c;
+	}
+	return NULL;
+}
+
+static inline bool key_equal(const struct encode_cache_key *a, const struct encode_cache_key *b)
+{
+	return a->tap == b->tap &&
+	       a->track == b->track &&
+	       a->rate_src == b->rate_src &&
+	       a->speakers == b->speakers &&
+	       a->channels == b->channels &&
+	       memcmp(&a->map, &b->map, sizeof(a->map)) == 0 &&
+	       a->rate_vban == b->rate_vban &&
+	       a->format_bit == b->format_bit &&
+	       a->dither == b->dither &&
+	       a->resampler_quality == b->resampler_quality;
+}
+
+static encode_cache_t *encode_cache_create_unlocked(const struct encode_cache_key *key)
+{
+	encode_cache_t *c = bzalloc(sizeof(struct encode_cache_s));
+	c->key = *key;
+	c->next = entries;
+	c->prev_next = &entries;
+	if (c->next)
+		c->next->prev_next = &c->next;
+	entries = c;
+
+	pthread_mutex_init(&c->mutex, NULL);
+
+	vban_encoder_init(&c->encoder, key->format_bit, &key->map, key->channels, key->dither);
+	if (key->rate_src != key->rate_vban)
+		c->resampler = vban_encode_create_resampler(key->rate_src, key->speakers, c->encoder.channels,
+							    key->rate_vban, key->resampler_quality);
+
+	return c;
+}
+
+encode_cache_t *encode_cache_find_or_create(const struct encode_cache_key *key)
+{
+	pthread_mutex_lock(&mutex);
+
+	encode_cache_t *c = NULL;
+	for (encode_cache_t *e = entries; e && !c; e = e->next) {
+		if (key_equal(&e->key, key))
+			c = encode_cache_get_ref(e);
+	}
+
+	if (!c)
+		c = encode_cache_create_unlocked(key);
+
+	pthread_mutex_unlock(&mutex);
+
+	return c;
+}
+
+static void encode_cache_destroy(encode_cache_t *c)
+{
+	pthread_mutex_lock(&mutex);
+	if (c->prev_next) {
+		*c->prev_next = c->next;
+		if (c->next)
+			c->next->prev_next = c->prev_next;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	blog(LOG_INFO, "encode-cache: %" PRIu64 " ticks encoded, %" PRIu64 " shared, %" PRIu64 " missed",
+	     c->cnt_encoded, c->cnt_shared, c->cnt_missed);
+	if (c->cnt_restarts)
+		blog(LOG_INFO, "encode-cache: restarted %" PRIu64 " times since the timestamps went back",
+		     c->cnt_restarts);
+
+	vban_encode_destroy_resampler(c->resampler);
+	for (size_t i = 0; i < ENCODE_CACHE_TICKS; i++)
+		darray_free(&c->ticks[i].data);
+	pthread_mutex_destroy(&c->mutex);
+	bfree(c);
+}
+
+void encode_cache_release(encode_cache_t *c)
+{
+	if (os_atomic_dec_long(&c->refcnt) == -1)
+		encode_cache_destroy(c);
+}
+
+static inline void append(struct darray *dst, const struct darray *src)
+{
+	size_t offset = dst->num;
+	darray_resize(1, dst, offset + src->num);
+	memcpy((char *)dst->array + offset, src->array, src->num);
+}
+
+bool encode_cache_get(encode_cache_t *c, const struct audio_data *pkt, struct darray *dst)
+{
+	pthread_mutex_lock(&c->mutex);
+
+	for (size_t i = 0; i < ENCODE_CACHE_TICKS; i++) {
+		const struct encoded_tick *tick = c->ticks + i;
+		if (tick->valid && tick->timestamp == pkt->timestamp && tick->frames == pkt->frames) {
+			append(dst, &tick->data);
+			c->cnt_shared++;
+			pthread_mutex_unlock(&c->mutex);
+			return true;
+		}
+	}
+
+	if (c->has_last && pkt->timestamp + ENCODE_CACHE_RESTART_NS < c->last_ts) {
+		for (size_t i = 0; i < ENCODE_CACHE_TICKS; i++)
+			c->ticks[i].valid = false;
+		c->has_last = false;
+		c->cnt_restarts++;
+	}
+	else if (c->has_last && pkt->timestamp <= c->last_ts) {
+		c->cnt_missed++;
+		pthread_mutex_unlock(&c->mutex);
+		return false;
+	}
+
+	struct encoded_tick *tick = c->ticks + c->next_tick;
+	c->next_tick = (c->next_tick + 1) % ENCODE_CACHE_TICKS;
+
+	tick->data.num = 0;
+	if (c->resampler)
+		tick->valid = vban_encode_resample(&c->encoder, c->resampler, pkt, &tick->data);
+	else {
+		vban_encode_convert(&c->encoder, pkt, &tick->data);
+		tick->valid = true;
+	}
+	tick->timestamp = pkt->timestamp;
+	tick->frames = pkt->frames;
+	c->has_last = true;
+	c->last_ts = pkt->timestamp;
+	c->cnt_encoded++;
+
+	if (tick->valid)
+		append(dst, &tick->data);
+
+	pthread_mutex_unlock(&c->mutex);
+	return tick->valid;
+}
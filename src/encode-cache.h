@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <media-io/audio-io.h>
+#include "vban-encode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Process-wide cache of encoded audio ticks.
+ *
+ * Outputs that tap the same audio and send it in the same format share an
+ * entry so that each audio tick is resampled and converted only once.
+ * Each output still receives the audio through its own ring and copies the
+ * encoded samples from the entry.
+ */
+
+struct darray;
+typedef struct encode_cache_s encode_cache_t;
+
+struct encode_cache_key
+{
+	const void *tap; // The audio the output is connected to
+	size_t track;
+	uint32_t rate_src;
+	enum speaker_layout speakers;
+	size_t channels; // of the audio
+	struct vban_channel_map_s map;
+	uint32_t rate_vban;
+	uint8_t format_bit;
+	bool dither;
+	int resampler_quality;
+};
+
+/**
+ * Find the entry matching the key or create a new entry.
+ * @param[in] key  The key.
+ * @return         The entry, which should be released by `encode_cache_release`.
+ */
+encode_cache_t *encode_cache_find_or_create(const struct encode_cache_key *key);
+
+/**
+ * Release the entry. The entry is destroyed when the last subscriber releases it.
+ * @param[in] c  The entry.
+ */
+void encode_cache_release(encode_cache_t *c);
+
+/**
+ * Get the encoded samples of an audio tick.
+ * @param[in] c        The entry.
+ * @param[in] pkt      The audio tick. Ticks are identified by the timestamp and the number of frames.
+ * @param[in,out] dst  The encoded samples are appended.
+ * @return             True if succeeded.
+ *
+ * If another subscriber has already encoded the tick, the samples are copied from the cache.
+ * Otherwise, if the tick is newer than any tick in the cache, the tick is encoded and kept.
+ * If the tick is older, the cache cannot encode it without disturbing the resampler;
+ * false is returned and the caller has to encode it by itself.
+ * A tick older by more than 500 ms means that the timestamps went back; the entry then starts over from it.
+ */
+bool encode_cache_get(encode_cache_t *c, const struct audio_data *pkt, struct darray *dst);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
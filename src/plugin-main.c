@@ -27,9 +27,13 @@ extern const struct obs_output_info vban_output_info;
 extern const struct obs_source_info vban_filter_info;
 
 void resolve_thread_wait_all();
+void resolve_cache_free(void);
+void vban_encode_init(void);
+void vban_sched_free(void);
 
 bool obs_module_load(void)
 {
+	vban_encode_init();
 	obs_register_source(&vban_source_info);
 	obs_register_output(&vban_output_info);
 	obs_register_source(&vban_filter_info);
@@ -39,6 +43,8 @@ bool obs_module_load(void)
 
 void obs_module_unload()
 {
+	resolve_cache_free();
 	resolve_thread_wait_all();
+	vban_sched_free();
 	blog(LOG_INFO, "plugin unloaded");
 }
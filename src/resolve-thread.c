@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include <obs-module.h>
+#include <util/platform.h>
 #include <util/threading.h>
 #include "socket.h"
 #ifndef _WIN32
@@ -186,6 +187,214 @@ bool resolve_thread_get_addr(const resolve_thread_t *ctx, struct in_addr *addr)
 	}
 }
 
+/* getaddrinfo does not tell the TTL of the record, so that the names are resolved again at this interval. */
+#define CACHE_REFRESH_NS (60 * 1000000000ULL)
+/* A name whose resolution failed is tried again after this time. */
+#define CACHE_RETRY_NS (5 * 1000000000ULL)
+
+struct resolve_cache_s
+{
+	struct resolve_cache_s *next;
+	struct resolve_cache_s **prev_next;
+
+	// protected by `cache_mutex`
+	long refcnt;
+	char *name;
+	uint64_t next_ns; // when to resolve again
+	bool resolving;
+	bool failing;
+
+	// read by the users without the lock
+	volatile long addr; // `s_addr`, valid if `gen` is not 0
+	volatile long gen;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct resolve_cache_s *cache_entries = NULL;
+static os_event_t *cache_event = NULL;
+static pthread_t cache_thread;
+static bool cache_running = false;
+static volatile bool cache_cont = false;
+
+static void *cache_thread_main(void *data);
+
+static void cache_free_unlocked(resolve_cache_t *c)
+{
+	*c->prev_next = c->next;
+	if (c->next)
+		c->next->prev_next = c->prev_next;
+	bfree(c->name);
+	bfree(c);
+}
+
+resolve_cache_t *resolve_cache_get(const char *name)
+{
+	if (!is_valid_hostname(name))
+		return NULL;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	for (resolve_cache_t *c = cache_entries; c; c = c->next) {
+		if (strcmp(c->name, name) == 0) {
+			c->refcnt++;
+			pthread_mutex_unlock(&cache_mutex);
+			return c;
+		}
+	}
+
+	if (!cache_running) {
+		if (!cache_event)
+			os_event_init(&cache_event, OS_EVENT_TYPE_AUTO);
+		cache_cont = true;
+		if (pthread_create(&cache_thread, NULL, cache_thread_main, NULL) == 0)
+			cache_running = true;
+		else
+			blog(LOG_ERROR, "resolve-cache: Failed to create thread");
+	}
+
+	resolve_cache_t *c = bzalloc(sizeof(struct resolve_cache_s));
+	c->refcnt = 1;
+	c->name = bstrdup(name);
+	c->next = cache_entries;
+	c->prev_next = &cache_entries;
+	if (c->next)
+		c->next->prev_next = &c->next;
+	cache_entries = c;
+
+	if (cache_running)
+		os_event_signal(cache_event);
+
+	pthread_mutex_unlock(&cache_mutex);
+
+	return c;
+}
+
+void resolve_cache_release(resolve_cache_t *c)
+{
+	pthread_mutex_lock(&cache_mutex);
+	// An entry being resolved is freed when the resolution finishes.
+	if (--c->refcnt == 0 && !c->resolving)
+		cache_free_unlocked(c);
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+bool resolve_cache_get_addr(const resolve_cache_t *c, struct in_addr *addr)
+{
+	if (!os_atomic_load_long(&c->gen))
+		return false;
+	addr->s_addr = (uint32_t)os_atomic_load_long(&c->addr);
+	return true;
+}
+
+long resolve_cache_generation(const resolve_cache_t *c)
+{
+	return os_atomic_load_long(&c->gen);
+}
+
+static void cache_finish(resolve_cache_t *c, const struct in_addr *addr)
+{
+	pthread_mutex_lock(&cache_mutex);
+
+	uint64_t now = os_gettime_ns();
+	c->resolving = false;
+
+	if (addr) {
+		bool resolved = os_atomic_load_long(&c->gen) != 0;
+		if (!resolved || (uint32_t)os_atomic_load_long(&c->addr) != addr->s_addr) {
+			blog(LOG_INFO, "resolve-cache: '%s' %s %s", c->name, resolved ? "moved to" : "resolved to",
+			     inet_ntoa(*addr));
+			os_atomic_store_long(&c->addr, (long)addr->s_addr);
+			os_atomic_inc_long(&c->gen);
+		}
+		c->failing = false;
+		c->next_ns = now + CACHE_REFRESH_NS;
+	}
+	else {
+		// The last address is kept so that the streams continue if the name server is temporarily unavailable.
+		if (!c->failing)
+			blog(LOG_WARNING, "resolve-cache: Failed to resolve '%s'", c->name);
+		c->failing = true;
+		c->next_ns = now + CACHE_RETRY_NS;
+	}
+
+	if (!c->refcnt)
+		cache_free_unlocked(c);
+	else if (cache_running)
+		os_event_signal(cache_event);
+
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+static void cache_resolved(void *data, const struct in_addr *addr)
+{
+	cache_finish(data, addr);
+}
+
+static void cache_failed(void *data)
+{
+	cache_finish(data, NULL);
+}
+
+/* Each resolution runs on its own thread so that a slow name does not delay the others. */
+static bool cache_start_unlocked(resolve_cache_t *c)
+{
+	resolve_thread_t *rt = resolve_thread_create(c->name);
+	if (!rt)
+		return false;
+
+	resolve_thread_set_callbacks(rt, c, cache_resolved, cache_failed);
+	c->resolving = resolve_thread_start(rt);
+	resolve_thread_release(rt);
+	return c->resolving;
+}
+
+static void *cache_thread_main(void *data)
+{
+	UNUSED_PARAMETER(data);
+	os_set_thread_name("vban-resolve");
+
+	while (cache_cont) {
+		uint64_t now = os_gettime_ns();
+		uint64_t wait_ns = CACHE_REFRESH_NS;
+
+		pthread_mutex_lock(&cache_mutex);
+		for (resolve_cache_t *c = cache_entries; c; c = c->next) {
+			if (c->resolving || !c->refcnt)
+				continue;
+			if (c->next_ns <= now && !cache_start_unlocked(c))
+				c->next_ns = now + CACHE_RETRY_NS;
+			if (!c->resolving && c->next_ns - now < wait_ns)
+				wait_ns = c->next_ns - now;
+		}
+		pthread_mutex_unlock(&cache_mutex);
+
+		os_event_timedwait(cache_event, (unsigned long)(wait_ns / 1000000) + 1);
+	}
+
+	return NULL;
+}
+
+void resolve_cache_free(void)
+{
+	pthread_mutex_lock(&cache_mutex);
+	bool running = cache_running;
+	cache_running = false;
+	cache_cont = false;
+	if (running)
+		os_event_signal(cache_event);
+	pthread_mutex_unlock(&cache_mutex);
+
+	if (running)
+		pthread_join(cache_thread, NULL);
+
+	// Resolutions in progress finish without the event.
+	pthread_mutex_lock(&cache_mutex);
+	if (cache_event)
+		os_event_destroy(cache_event);
+	cache_event = NULL;
+	pthread_mutex_unlock(&cache_mutex);
+}
+
 void resolve_thread_wait_all()
 {
 	pthread_mutex_lock(&mutex);
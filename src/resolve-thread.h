@@ -79,6 +79,55 @@ bool resolve_thread_done(const resolve_thread_t *ctx);
  */
 bool resolve_thread_get_addr(const resolve_thread_t *ctx, struct in_addr *addr);
 
+/**
+ * Shared cache of resolved host names.
+ *
+ * Each name has one entry shared by all users, which is resolved in the
+ * background when created and again at a fixed interval. If a resolution
+ * fails, the last address is kept. The address is replaced atomically so
+ * that users can read it at any time without waiting for the resolution.
+ */
+
+typedef struct resolve_cache_s resolve_cache_t;
+
+/**
+ * Get the entry of a host name, which is created and resolved if not cached.
+ * @param[in] name  Host name
+ * @return          The entry, or NULL if the name is not valid.
+ *
+ * The returned entry should be released by `resolve_cache_release`.
+ */
+resolve_cache_t *resolve_cache_get(const char *name);
+
+/**
+ * Release the entry.
+ * @param[in] c  The entry.
+ */
+void resolve_cache_release(resolve_cache_t *c);
+
+/**
+ * Query the current address.
+ * @param[in] c      The entry.
+ * @param[out] addr  Pointer to store the address.
+ * @return           True if the name has been resolved at least once.
+ *
+ * Neither a lock nor a system call is involved so that this can be called for each packet.
+ * If the name has not been resolved, `*addr` won't be updated.
+ */
+bool resolve_cache_get_addr(const resolve_cache_t *c, struct in_addr *addr);
+
+/**
+ * Query how many times the address has changed.
+ * @param[in] c  The entry.
+ * @return       0 until the name is resolved, incremented each time a different address is resolved.
+ */
+long resolve_cache_generation(const resolve_cache_t *c);
+
+/**
+ * Stop the background resolution. Called when the module is unloaded.
+ */
+void resolve_cache_free(void);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
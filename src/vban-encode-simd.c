@@ -0,0 +1,810 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <string.h>
+#include <math.h>
+#include "vban-encode-simd.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define ARCH_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+static void quantize_c(int32_t *dst, const float *src, const float *noise, size_t n, float scale, float max)
+{
+	const float min = -scale;
+	for (size_t i = 0; i < n; i++) {
+		float x = src[i] * scale;
+		if (noise)
+			x += noise[i];
+		if (!(x >= min)) // also catches NaN
+			x = min;
+		if (x > max)
+			x = max;
+		// Round to nearest even like the vector kernels; `x - 0.5f` is not exact near the 24-bit full scale.
+		dst[i] = (int32_t)lrintf(x);
+	}
+}
+
+static void interleave16x2_c(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		*dst++ = (uint8_t)(l[i] & 0xFF);
+		*dst++ = (uint8_t)((l[i] >> 8) & 0xFF);
+		*dst++ = (uint8_t)(r[i] & 0xFF);
+		*dst++ = (uint8_t)((r[i] >> 8) & 0xFF);
+	}
+}
+
+static void interleave24x2_c(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		*dst++ = (uint8_t)(l[i] & 0xFF);
+		*dst++ = (uint8_t)((l[i] >> 8) & 0xFF);
+		*dst++ = (uint8_t)((l[i] >> 16) & 0xFF);
+		*dst++ = (uint8_t)(r[i] & 0xFF);
+		*dst++ = (uint8_t)((r[i] >> 8) & 0xFF);
+		*dst++ = (uint8_t)((r[i] >> 16) & 0xFF);
+	}
+}
+
+static void interleave32x2_c(uint8_t *dst, const void *l, const void *r, size_t n)
+{
+	const uint8_t *a = l;
+	const uint8_t *b = r;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t x, y;
+		memcpy(&x, a + i * 4, 4);
+		memcpy(&y, b + i * 4, 4);
+		for (int k = 0; k < 32; k += 8)
+			*dst++ = (uint8_t)(x >> k);
+		for (int k = 0; k < 32; k += 8)
+			*dst++ = (uint8_t)(y >> k);
+	}
+}
+
+static float dot_c(const float *a, const float *b, size_t n)
+{
+	float s = 0.0f;
+	for (size_t i = 0; i < n; i++)
+		s += a[i] * b[i];
+	return s;
+}
+
+static void mix_c(float *dst, const float *const *src, const float *gain, size_t n_src, size_t n)
+{
+	if (!n_src) {
+		memset(dst, 0, n * sizeof(float));
+		return;
+	}
+	for (size_t i = 0; i < n; i++)
+		dst[i] = src[0][i] * gain[0];
+	for (size_t k = 1; k < n_src; k++) {
+		for (size_t i = 0; i < n; i++)
+			dst[i] += src[k][i] * gain[k];
+	}
+}
+
+static float peak_c(const float *src, size_t n)
+{
+	float m = 0.0f;
+	for (size_t i = 0; i < n; i++) {
+		float a = src[i] < 0.0f ? -src[i] : src[i];
+		if (a != a)
+			return INFINITY;
+		if (a > m)
+			m = a;
+	}
+	return m;
+}
+
+static inline void pack_bits_c(uint8_t *dst, const int16_t *src, size_t n, unsigned bits)
+{
+	const uint32_t mask = (1u << bits) - 1;
+	uint32_t acc = 0;
+	unsigned n_acc = 0;
+	for (size_t i = 0; i < n; i++) {
+		acc |= ((uint32_t)src[i] & mask) << n_acc;
+		for (n_acc += bits; n_acc >= 8; n_acc -= 8) {
+			*dst++ = (uint8_t)acc;
+			acc >>= 8;
+		}
+	}
+	if (n_acc)
+		*dst = (uint8_t)acc;
+}
+
+static inline void unpack_bits_c(int16_t *dst, const uint8_t *src, size_t n, unsigned bits)
+{
+	const uint32_t mask = (1u << bits) - 1;
+	uint32_t acc = 0;
+	unsigned n_acc = 0;
+	for (size_t i = 0; i < n; i++) {
+		for (; n_acc < bits; n_acc += 8)
+			acc |= (uint32_t)*src++ << n_acc;
+		dst[i] = (int16_t)(uint16_t)((acc & mask) << (16 - bits));
+		acc >>= bits;
+		n_acc -= bits;
+	}
+}
+
+static void pack12_c(uint8_t *dst, const int16_t *src, size_t n)
+{
+	pack_bits_c(dst, src, n, 12);
+}
+
+static void pack10_c(uint8_t *dst, const int16_t *src, size_t n)
+{
+	pack_bits_c(dst, src, n, 10);
+}
+
+static void unpack12_c(int16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack_bits_c(dst, src, n, 12);
+}
+
+static void unpack10_c(int16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack_bits_c(dst, src, n, 10);
+}
+
+/* The vector kernels pack 8 samples at a time: pairs of samples are joined in 32-bit lanes
+ * and pairs of those in 64-bit lanes, whose lowest `4 * bits` bits are stored.
+ * Unpacking does the reverse. Both are little-endian. */
+static inline void store_bits64(uint8_t *dst, uint64_t lo, uint64_t hi, size_t bytes)
+{
+	memcpy(dst, &lo, bytes);
+	memcpy(dst + bytes, &hi, bytes);
+}
+
+static inline void load_bits64(const uint8_t *src, uint64_t *lo, uint64_t *hi, size_t bytes)
+{
+	*lo = *hi = 0;
+	memcpy(lo, src, bytes);
+	memcpy(hi, src + bytes, bytes);
+}
+
+/* Fixed sizes let the compiler turn each copy into one load and one store. */
+#define INTERLEAVE_UNITS_LOOP(size)                                                    \
+	for (size_t i = 0; i < frames; i++) {                                          \
+		for (size_t k = 0; k < n_src; k++) {                                   \
+			memcpy(dst, src[k] + i * (size), (size));                      \
+			dst += (size);                                                 \
+		}                                                                      \
+	}
+
+static void interleave_units_c(uint8_t *dst, const uint8_t *const *src, size_t n_src, size_t unit, size_t frames)
+{
+	switch (unit) {
+	case 2:
+		INTERLEAVE_UNITS_LOOP(2);
+		break;
+	case 4:
+		INTERLEAVE_UNITS_LOOP(4);
+		break;
+	case 6:
+		INTERLEAVE_UNITS_LOOP(6);
+		break;
+	case 8:
+		INTERLEAVE_UNITS_LOOP(8);
+		break;
+	default:
+		INTERLEAVE_UNITS_LOOP(unit);
+		break;
+	}
+}
+
+/* Calls the C kernel for the frames from `done` that the vector loop did not process. */
+static inline void interleave_units_tail(uint8_t *dst, const uint8_t *const *src, size_t n_src, size_t unit,
+					 size_t frames, size_t done)
+{
+	if (done >= frames)
+		return;
+	const uint8_t *tail[4];
+	for (size_t k = 0; k < n_src; k++)
+		tail[k] = src[k] + done * unit;
+	interleave_units_c(dst + done * n_src * unit, tail, n_src, unit, frames - done);
+}
+
+#ifdef HAVE_SSE2
+static void interleave_units_sse2(uint8_t *dst, const uint8_t *const *src, size_t n_src, size_t unit, size_t frames)
+{
+	size_t i = 0;
+	if (n_src == 2 && unit == 4) {
+		// stereo 16-bit tracks
+		for (; i + 4 <= frames; i += 4) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(src[0] + i * 4));
+			__m128i b = _mm_loadu_si128((const __m128i *)(src[1] + i * 4));
+			_mm_storeu_si128((__m128i *)(dst + i * 8), _mm_unpacklo_epi32(a, b));
+			_mm_storeu_si128((__m128i *)(dst + i * 8 + 16), _mm_unpackhi_epi32(a, b));
+		}
+	}
+	else if (n_src == 2 && unit == 8) {
+		// stereo float tracks
+		for (; i + 2 <= frames; i += 2) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(src[0] + i * 8));
+			__m128i b = _mm_loadu_si128((const __m128i *)(src[1] + i * 8));
+			_mm_storeu_si128((__m128i *)(dst + i * 16), _mm_unpacklo_epi64(a, b));
+			_mm_storeu_si128((__m128i *)(dst + i * 16 + 16), _mm_unpackhi_epi64(a, b));
+		}
+	}
+	else if (n_src == 4 && unit == 4) {
+		// 4x4 transpose of 32-bit units
+		for (; i + 4 <= frames; i += 4) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(src[0] + i * 4));
+			__m128i b = _mm_loadu_si128((const __m128i *)(src[1] + i * 4));
+			__m128i c = _mm_loadu_si128((const __m128i *)(src[2] + i * 4));
+			__m128i d = _mm_loadu_si128((const __m128i *)(src[3] + i * 4));
+			__m128i ab0 = _mm_unpacklo_epi32(a, b), ab1 = _mm_unpackhi_epi32(a, b);
+			__m128i cd0 = _mm_unpacklo_epi32(c, d), cd1 = _mm_unpackhi_epi32(c, d);
+			_mm_storeu_si128((__m128i *)(dst + i * 16), _mm_unpacklo_epi64(ab0, cd0));
+			_mm_storeu_si128((__m128i *)(dst + i * 16 + 16), _mm_unpackhi_epi64(ab0, cd0));
+			_mm_storeu_si128((__m128i *)(dst + i * 16 + 32), _mm_unpacklo_epi64(ab1, cd1));
+			_mm_storeu_si128((__m128i *)(dst + i * 16 + 48), _mm_unpackhi_epi64(ab1, cd1));
+		}
+	}
+	else {
+		interleave_units_c(dst, src, n_src, unit, frames);
+		return;
+	}
+	interleave_units_tail(dst, src, n_src, unit, frames, i);
+}
+
+static float dot_sse2(const float *a, const float *b, size_t n)
+{
+	__m128 s0 = _mm_setzero_ps();
+	__m128 s1 = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	s0 = _mm_add_ps(s0, s1);
+	s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+	s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+	return _mm_cvtss_f32(s0) + dot_c(a + i, b + i, n - i);
+}
+
+/* Two channels are summed per pass so that `dst` is loaded and stored half as often. */
+static void mix_sse2(float *dst, const float *const *src, const float *gain, size_t n_src, size_t n)
+{
+	if (n_src < 2) {
+		mix_c(dst, src, gain, n_src, n);
+		return;
+	}
+
+	for (size_t k = 0; k + 1 < n_src; k += 2) {
+		const float *a = src[k];
+		const float *b = src[k + 1];
+		const __m128 ga = _mm_set1_ps(gain[k]);
+		const __m128 gb = _mm_set1_ps(gain[k + 1]);
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), ga), _mm_mul_ps(_mm_loadu_ps(b + i), gb));
+			if (k)
+				x = _mm_add_ps(x, _mm_loadu_ps(dst + i));
+			_mm_storeu_ps(dst + i, x);
+		}
+		for (; i < n; i++)
+			dst[i] = (k ? dst[i] : 0.0f) + a[i] * gain[k] + b[i] * gain[k + 1];
+	}
+
+	if (n_src & 1) {
+		const float *a = src[n_src - 1];
+		const __m128 ga = _mm_set1_ps(gain[n_src - 1]);
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(a + i), ga)));
+		for (; i < n; i++)
+			dst[i] += a[i] * gain[n_src - 1];
+	}
+}
+
+static float peak_sse2(const float *src, size_t n)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 m = _mm_setzero_ps();
+	__m128 nan = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_and_ps(_mm_loadu_ps(src + i), abs_mask);
+		m = _mm_max_ps(m, x);
+		nan = _mm_or_ps(nan, _mm_cmpunord_ps(x, x));
+	}
+	if (_mm_movemask_ps(nan))
+		return INFINITY;
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	float tail = peak_c(src + i, n - i);
+	float head = _mm_cvtss_f32(m);
+	return tail > head ? tail : head;
+}
+
+static void quantize_sse2(int32_t *dst, const float *src, const float *noise, size_t n, float scale, float max)
+{
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 vmin = _mm_set1_ps(-scale);
+	const __m128 vmax = _mm_set1_ps(max);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_mul_ps(_mm_loadu_ps(src + i), vscale);
+		if (noise)
+			x = _mm_add_ps(x, _mm_loadu_ps(noise + i));
+		// `_mm_max_ps` returns the second operand if the first one is NaN.
+		x = _mm_min_ps(_mm_max_ps(x, vmin), vmax);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(x));
+	}
+	if (i < n)
+		quantize_c(dst + i, src + i, noise ? noise + i : NULL, n - i, scale, max);
+}
+
+static inline void pack_bits_sse2(uint8_t *dst, const int16_t *src, size_t n, unsigned bits)
+{
+	const __m128i mask16 = _mm_set1_epi16((short)((1 << bits) - 1));
+	const __m128i mask32 = _mm_set1_epi32(0xFFFF);
+	const __m128i mask64 = _mm_set_epi32(0, -1, 0, -1);
+	const __m128i shift32 = _mm_cvtsi32_si128((int)bits);
+	const __m128i shift64 = _mm_cvtsi32_si128((int)bits * 2);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8, dst += bits) {
+		__m128i x = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + i)), mask16);
+		x = _mm_or_si128(_mm_and_si128(x, mask32), _mm_sll_epi32(_mm_srli_epi32(x, 16), shift32));
+		x = _mm_or_si128(_mm_and_si128(x, mask64), _mm_sll_epi64(_mm_srli_epi64(x, 32), shift64));
+		uint64_t lo, hi;
+		_mm_storel_epi64((__m128i *)&lo, x);
+		_mm_storel_epi64((__m128i *)&hi, _mm_unpackhi_epi64(x, x));
+		store_bits64(dst, lo, hi, bits / 2);
+	}
+	if (i < n)
+		pack_bits_c(dst, src + i, n - i, bits);
+}
+
+static inline void unpack_bits_sse2(int16_t *dst, const uint8_t *src, size_t n, unsigned bits)
+{
+	const __m128i mask32 = _mm_set_epi32(0, (1 << bits * 2) - 1, 0, (1 << bits * 2) - 1);
+	const __m128i mask16 = _mm_set1_epi32((1 << bits) - 1);
+	const __m128i shift32 = _mm_cvtsi32_si128((int)bits);
+	const __m128i shift64 = _mm_cvtsi32_si128((int)bits * 2);
+	const __m128i shift16 = _mm_cvtsi32_si128(16 - (int)bits);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8, src += bits) {
+		uint64_t lo, hi;
+		load_bits64(src, &lo, &hi, bits / 2);
+		__m128i x = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)&lo),
+					       _mm_loadl_epi64((const __m128i *)&hi));
+		x = _mm_or_si128(_mm_and_si128(x, mask32), _mm_slli_epi64(_mm_srl_epi64(x, shift64), 32));
+		x = _mm_or_si128(_mm_and_si128(x, mask16), _mm_slli_epi32(_mm_srl_epi32(x, shift32), 16));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_sll_epi16(x, shift16));
+	}
+	if (i < n)
+		unpack_bits_c(dst + i, src, n - i, bits);
+}
+
+static void pack12_sse2(uint8_t *dst, const int16_t *src, size_t n)
+{
+	pack_bits_sse2(dst, src, n, 12);
+}
+
+static void pack10_sse2(uint8_t *dst, const int16_t *src, size_t n)
+{
+	pack_bits_sse2(dst, src, n, 10);
+}
+
+static void unpack12_sse2(int16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack_bits_sse2(dst, src, n, 12);
+}
+
+static void unpack10_sse2(int16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack_bits_sse2(dst, src, n, 10);
+}
+
+static void interleave16x2_sse2(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i vl = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(l + i)),
+					     _mm_loadu_si128((const __m128i *)(l + i + 4)));
+		__m128i vr = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(r + i)),
+					     _mm_loadu_si128((const __m128i *)(r + i + 4)));
+		_mm_storeu_si128((__m128i *)(dst + i * 4), _mm_unpacklo_epi16(vl, vr));
+		_mm_storeu_si128((__m128i *)(dst + i * 4 + 16), _mm_unpackhi_epi16(vl, vr));
+	}
+	if (i < n)
+		interleave16x2_c(dst + i * 4, l + i, r + i, n - i);
+}
+
+/* Stores the low 24 bits of each sample of two interleaved frames as 12 bytes. */
+static inline void store24x4_sse2(uint8_t *dst, __m128i v)
+{
+	const __m128i mask_lo = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+	const __m128i mask_hi = _mm_set_epi32(0x0000FFFF, (int)0xFF000000, 0x0000FFFF, (int)0xFF000000);
+
+	// Each 64-bit lane holds a frame of 6 bytes, then the upper frame is moved next to the lower one.
+	__m128i f = _mm_or_si128(_mm_and_si128(v, mask_lo), _mm_and_si128(_mm_srli_epi64(v, 8), mask_hi));
+	__m128i p = _mm_or_si128(_mm_move_epi64(f), _mm_slli_si128(_mm_srli_si128(f, 8), 6));
+
+	_mm_storel_epi64((__m128i *)dst, p);
+	uint32_t w = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(p, 8));
+	memcpy(dst + 8, &w, 4);
+}
+
+static void interleave24x2_sse2(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i vl = _mm_loadu_si128((const __m128i *)(l + i));
+		__m128i vr = _mm_loadu_si128((const __m128i *)(r + i));
+		store24x4_sse2(dst + i * 6, _mm_unpacklo_epi32(vl, vr));
+		store24x4_sse2(dst + i * 6 + 12, _mm_unpackhi_epi32(vl, vr));
+	}
+	if (i < n)
+		interleave24x2_c(dst + i * 6, l + i, r + i, n - i);
+}
+
+static void interleave32x2_sse2(uint8_t *dst, const void *l, const void *r, size_t n)
+{
+	const uint8_t *a = l;
+	const uint8_t *b = r;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i vl = _mm_loadu_si128((const __m128i *)(a + i * 4));
+		__m128i vr = _mm_loadu_si128((const __m128i *)(b + i * 4));
+		_mm_storeu_si128((__m128i *)(dst + i * 8), _mm_unpacklo_epi32(vl, vr));
+		_mm_storeu_si128((__m128i *)(dst + i * 8 + 16), _mm_unpackhi_epi32(vl, vr));
+	}
+	if (i < n)
+		interleave32x2_c(dst + i * 8, a + i * 4, b + i * 4, n - i);
+}
+#endif
+
+#ifdef ARCH_X86
+TARGET_AVX2 static void quantize_avx2(int32_t *dst, const float *src, const float *noise, size_t n, float scale,
+				      float max)
+{
+	const __m256 vscale = _mm256_set1_ps(scale);
+	const __m256 vmin = _mm256_set1_ps(-scale);
+	const __m256 vmax = _mm256_set1_ps(max);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 x = _mm256_mul_ps(_mm256_loadu_ps(src + i), vscale);
+		if (noise)
+			x = _mm256_add_ps(x, _mm256_loadu_ps(noise + i));
+		x = _mm256_min_ps(_mm256_max_ps(x, vmin), vmax);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtps_epi32(x));
+	}
+	if (i < n)
+		quantize_c(dst + i, src + i, noise ? noise + i : NULL, n - i, scale, max);
+}
+
+TARGET_AVX2 static float dot_avx2(const float *a, const float *b, size_t n)
+{
+	__m256 s0 = _mm256_setzero_ps();
+	__m256 s1 = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+		s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+	}
+	s0 = _mm256_add_ps(s0, s1);
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s) + dot_c(a + i, b + i, n - i);
+}
+
+static bool cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#ifdef HAVE_NEON
+static void quantize_neon(int32_t *dst, const float *src, const float *noise, size_t n, float scale, float max)
+{
+	const float32x4_t vmin = vdupq_n_f32(-scale);
+	const float32x4_t vmax = vdupq_n_f32(max);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t x = vmulq_n_f32(vld1q_f32(src + i), scale);
+		if (noise)
+			x = vaddq_f32(x, vld1q_f32(noise + i));
+		// `vmaxnmq_f32` returns the number if the other operand is NaN.
+		x = vminq_f32(vmaxnmq_f32(x, vmin), vmax);
+		vst1q_s32(dst + i, vcvtnq_s32_f32(x));
+	}
+	if (i < n)
+		quantize_c(dst + i, src + i, noise ? noise + i : NULL, n - i, scale, max);
+}
+
+static float dot_neon(const float *a, const float *b, size_t n)
+{
+	float32x4_t s0 = vdupq_n_f32(0.0f);
+	float32x4_t s1 = vdupq_n_f32(0.0f);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		s0 = vfmaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+		s1 = vfmaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	return vaddvq_f32(vaddq_f32(s0, s1)) + dot_c(a + i, b + i, n - i);
+}
+
+static float peak_neon(const float *src, size_t n)
+{
+	float32x4_t m = vdupq_n_f32(0.0f);
+	size_t i = 0;
+	// `vmaxq_f32` returns NaN if either operand is NaN.
+	for (; i + 4 <= n; i += 4)
+		m = vmaxq_f32(m, vabsq_f32(vld1q_f32(src + i)));
+	float head = vmaxvq_f32(m);
+	if (head != head)
+		return INFINITY;
+	float tail = peak_c(src + i, n - i);
+	return tail > head ? tail : head;
+}
+
+static void mix_neon(float *dst, const float *const *src, const float *gain, size_t n_src, size_t n)
+{
+	if (n_src < 2) {
+		mix_c(dst, src, gain, n_src, n);
+		return;
+	}
+
+	for (size_t k = 0; k + 1 < n_src; k += 2) {
+		const float *a = src[k];
+		const float *b = src[k + 1];
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			float32x4_t x = k ? vld1q_f32(dst + i) : vdupq_n_f32(0.0f);
+			x = vfmaq_n_f32(x, vld1q_f32(a + i), gain[k]);
+			x = vfmaq_n_f32(x, vld1q_f32(b + i), gain[k + 1]);
+			vst1q_f32(dst + i, x);
+		}
+		for (; i < n; i++)
+			dst[i] = (k ? dst[i] : 0.0f) + a[i] * gain[k] + b[i] * gain[k + 1];
+	}
+
+	if (n_src & 1) {
+		const float *a = src[n_src - 1];
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4)
+			vst1q_f32(dst + i, vfmaq_n_f32(vld1q_f32(dst + i), vld1q_f32(a + i), gain[n_src - 1]));
+		for (; i < n; i++)
+			dst[i] += a[i] * gain[n_src - 1];
+	}
+}
+
+static void interleave_units_neon(uint8_t *dst, const uint8_t *const *src, size_t n_src, size_t unit, size_t frames)
+{
+	size_t i = 0;
+	if (n_src == 2 && unit == 4) {
+		for (; i + 4 <= frames; i += 4) {
+			uint32x4x2_t v = {{vld1q_u32((const uint32_t *)(src[0] + i * 4)),
+					   vld1q_u32((const uint32_t *)(src[1] + i * 4))}};
+			vst2q_u32((uint32_t *)(dst + i * 8), v);
+		}
+	}
+	else if (n_src == 2 && unit == 8) {
+		for (; i + 2 <= frames; i += 2) {
+			uint64x2x2_t v = {{vld1q_u64((const uint64_t *)(src[0] + i * 8)),
+					   vld1q_u64((const uint64_t *)(src[1] + i * 8))}};
+			vst2q_u64((uint64_t *)(dst + i * 16), v);
+		}
+	}
+	else if (n_src == 4 && unit == 4) {
+		for (; i + 4 <= frames; i += 4) {
+			uint32x4x4_t v = {{vld1q_u32((const uint32_t *)(src[0] + i * 4)),
+					   vld1q_u32((const uint32_t *)(src[1] + i * 4)),
+					   vld1q_u32((const uint32_t *)(src[2] + i * 4)),
+					   vld1q_u32((const uint32_t *)(src[3] + i * 4))}};
+			vst4q_u32((uint32_t *)(dst + i * 16), v);
+		}
+	}
+	else {
+		interleave_units_c(dst, src, n_src, unit, frames);
+		return;
+	}
+	interleave_units_tail(dst, src, n_src, unit, frames, i);
+}
+
+static inline void pack_bits_neon(uint8_t *dst, const int16_t *src, size_t n, unsigned bits)
+{
+	const uint16x8_t mask16 = vdupq_n_u16((uint16_t)((1 << bits) - 1));
+	const uint32x4_t mask32 = vdupq_n_u32(0xFFFF);
+	const uint64x2_t mask64 = vdupq_n_u64(0xFFFFFFFF);
+	const int32x4_t shift32 = vdupq_n_s32((int32_t)bits);
+	const int64x2_t shift64 = vdupq_n_s64((int64_t)bits * 2);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8, dst += bits) {
+		uint32x4_t x32 = vreinterpretq_u32_u16(vandq_u16(vreinterpretq_u16_s16(vld1q_s16(src + i)), mask16));
+		x32 = vorrq_u32(vandq_u32(x32, mask32), vshlq_u32(vshrq_n_u32(x32, 16), shift32));
+		uint64x2_t x64 = vreinterpretq_u64_u32(x32);
+		x64 = vorrq_u64(vandq_u64(x64, mask64), vshlq_u64(vshrq_n_u64(x64, 32), shift64));
+		store_bits64(dst, vgetq_lane_u64(x64, 0), vgetq_lane_u64(x64, 1), bits / 2);
+	}
+	if (i < n)
+		pack_bits_c(dst, src + i, n - i, bits);
+}
+
+static inline void unpack_bits_neon(int16_t *dst, const uint8_t *src, size_t n, unsigned bits)
+{
+	const uint64x2_t mask64 = vdupq_n_u64((1u << bits * 2) - 1);
+	const uint32x4_t mask32 = vdupq_n_u32((1u << bits) - 1);
+	// Right shifts by a vector are left shifts by negative counts.
+	const int64x2_t shift64 = vdupq_n_s64(-(int64_t)bits * 2);
+	const int32x4_t shift32 = vdupq_n_s32(-(int32_t)bits);
+	const int16x8_t shift16 = vdupq_n_s16((int16_t)(16 - bits));
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8, src += bits) {
+		uint64_t lo, hi;
+		load_bits64(src, &lo, &hi, bits / 2);
+		uint64x2_t x64 = vcombine_u64(vcreate_u64(lo), vcreate_u64(hi));
+		x64 = vorrq_u64(vandq_u64(x64, mask64), vshlq_n_u64(vshlq_u64(x64, shift64), 32));
+		uint32x4_t x32 = vreinterpretq_u32_u64(x64);
+		x32 = vorrq_u32(vandq_u32(x32, mask32), vshlq_n_u32(vshlq_u32(x32, shift32), 16));
+		vst1q_s16(dst + i, vreinterpretq_s16_u16(vshlq_u16(vreinterpretq_u16_u32(x32), shift16)));
+	}
+	if (i < n)
+		unpack_bits_c(dst + i, src, n - i, bits);
+}
+
+static void pack12_neon(uint8_t *dst, const int16_t *src, size_t n)
+{
+	pack_bits_neon(dst, src, n, 12);
+}
+
+static void pack10_neon(uint8_t *dst, const int16_t *src, size_t n)
+{
+	pack_bits_neon(dst, src, n, 10);
+}
+
+static void unpack12_neon(int16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack_bits_neon(dst, src, n, 12);
+}
+
+static void unpack10_neon(int16_t *dst, const uint8_t *src, size_t n)
+{
+	unpack_bits_neon(dst, src, n, 10);
+}
+
+static void interleave16x2_neon(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		int16x8x2_t v;
+		v.val[0] = vcombine_s16(vqmovn_s32(vld1q_s32(l + i)), vqmovn_s32(vld1q_s32(l + i + 4)));
+		v.val[1] = vcombine_s16(vqmovn_s32(vld1q_s32(r + i)), vqmovn_s32(vld1q_s32(r + i + 4)));
+		vst2q_s16((int16_t *)(dst + i * 4), v);
+	}
+	if (i < n)
+		interleave16x2_c(dst + i * 4, l + i, r + i, n - i);
+}
+
+static void interleave24x2_neon(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n)
+{
+	// Drops the highest byte of each 32-bit sample.
+	static const uint8_t idx[16] = {0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 255, 255, 255, 255};
+	const uint8x16_t tbl = vld1q_u8(idx);
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		int32x4x2_t z = vzipq_s32(vld1q_s32(l + i), vld1q_s32(r + i));
+		for (int k = 0; k < 2; k++) {
+			uint8x16_t p = vqtbl1q_u8(vreinterpretq_u8_s32(z.val[k]), tbl);
+			uint8_t *d = dst + i * 6 + k * 12;
+			vst1_u8(d, vget_low_u8(p));
+			vst1_lane_u32((uint32_t *)(d + 8), vreinterpret_u32_u8(vget_high_u8(p)), 0);
+		}
+	}
+	if (i < n)
+		interleave24x2_c(dst + i * 6, l + i, r + i, n - i);
+}
+
+static void interleave32x2_neon(uint8_t *dst, const void *l, const void *r, size_t n)
+{
+	const uint8_t *a = l;
+	const uint8_t *b = r;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		uint32x4x2_t v;
+		v.val[0] = vreinterpretq_u32_u8(vld1q_u8(a + i * 4));
+		v.val[1] = vreinterpretq_u32_u8(vld1q_u8(b + i * 4));
+		vst2q_u32((uint32_t *)(dst + i * 8), v);
+	}
+	if (i < n)
+		interleave32x2_c(dst + i * 8, a + i * 4, b + i * 4, n - i);
+}
+#endif
+
+void vban_encode_kernels_portable(struct vban_encode_kernels *k)
+{
+	k->name = "C";
+	k->quantize = quantize_c;
+	k->interleave16x2 = interleave16x2_c;
+	k->interleave24x2 = interleave24x2_c;
+	k->interleave32x2 = interleave32x2_c;
+	k->dot = dot_c;
+	k->interleave_units = interleave_units_c;
+	k->mix = mix_c;
+	k->peak = peak_c;
+	k->pack12 = pack12_c;
+	k->pack10 = pack10_c;
+	k->unpack12 = unpack12_c;
+	k->unpack10 = unpack10_c;
+}
+
+void vban_encode_kernels_select(struct vban_encode_kernels *k)
+{
+	vban_encode_kernels_portable(k);
+
+#ifdef HAVE_SSE2
+	k->name = "SSE2";
+	k->quantize = quantize_sse2;
+	k->interleave16x2 = interleave16x2_sse2;
+	k->interleave24x2 = interleave24x2_sse2;
+	k->interleave32x2 = interleave32x2_sse2;
+	k->dot = dot_sse2;
+	k->interleave_units = interleave_units_sse2;
+	k->mix = mix_sse2;
+	k->peak = peak_sse2;
+	k->pack12 = pack12_sse2;
+	k->pack10 = pack10_sse2;
+	k->unpack12 = unpack12_sse2;
+	k->unpack10 = unpack10_sse2;
+#endif
+
+#ifdef ARCH_X86
+	if (cpu_has_avx2()) {
+		k->name = k->interleave16x2 == interleave16x2_c ? "AVX2" : "AVX2+SSE2";
+		k->quantize = quantize_avx2;
+		k->dot = dot_avx2;
+	}
+#endif
+
+#ifdef HAVE_NEON
+	k->name = "NEON";
+	k->quantize = quantize_neon;
+	k->interleave16x2 = interleave16x2_neon;
+	k->interleave24x2 = interleave24x2_neon;
+	k->interleave32x2 = interleave32x2_neon;
+	k->dot = dot_neon;
+	k->interleave_units = interleave_units_neon;
+	k->mix = mix_neon;
+	k->peak = peak_neon;
+	k->pack12 = pack12_neon;
+	k->pack10 = pack10_neon;
+	k->unpack12 = unpack12_neon;
+	k->unpack10 = unpack10_neon;
+#endif
+}
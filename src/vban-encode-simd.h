@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Scale, add dither noise, saturate and round samples.
+ * @param[out] dst   Quantized samples.
+ * @param[in] src    Float samples.
+ * @param[in] noise  Noise added after scaling, or NULL.
+ * @param[in] n      Number of samples.
+ * @param[in] scale  Full scale, e.g. 32768 for 16-bit.
+ * @param[in] max    Largest output, which has to be exactly representable as float.
+ *
+ * NaN is mapped to the negative full scale.
+ */
+typedef void (*vban_quantize_fn)(int32_t *dst, const float *src, const float *noise, size_t n, float scale,
+				 float max);
+
+/**
+ * Interleave two channels of 16-bit samples.
+ * @param[out] dst  Interleaved little-endian samples, `n * 4` bytes.
+ * @param[in] l     First channel, already saturated to 16-bit.
+ * @param[in] r     Second channel, already saturated to 16-bit.
+ * @param[in] n     Number of frames.
+ */
+typedef void (*vban_interleave16x2_fn)(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n);
+
+/**
+ * Interleave two channels of 24-bit samples.
+ * @param[out] dst  Interleaved little-endian samples, `n * 6` bytes.
+ * @param[in] l     First channel, already saturated to 24-bit.
+ * @param[in] r     Second channel, already saturated to 24-bit.
+ * @param[in] n     Number of frames.
+ */
+typedef void (*vban_interleave24x2_fn)(uint8_t *dst, const int32_t *l, const int32_t *r, size_t n);
+
+/**
+ * Interleave two channels of 32-bit samples, either integer or float.
+ * @param[out] dst  Interleaved little-endian samples, `n * 8` bytes.
+ * @param[in] l     First channel.
+ * @param[in] r     Second channel.
+ * @param[in] n     Number of frames.
+ */
+typedef void (*vban_interleave32x2_fn)(uint8_t *dst, const void *l, const void *r, size_t n);
+
+/**
+ * Inner product of two vectors.
+ * @param[in] a  First vector.
+ * @param[in] b  Second vector.
+ * @param[in] n  Number of elements.
+ * @return       The sum of `a[i] * b[i]`.
+ */
+typedef float (*vban_dot_fn)(const float *a, const float *b, size_t n);
+
+/**
+ * Interleave frames of several sources into wider frames.
+ * @param[out] dst    Interleaved frames, `frames * n_src * unit` bytes.
+ * @param[in] src     Contiguous frames of each source.
+ * @param[in] n_src   Number of sources.
+ * @param[in] unit    Size of one frame of a source in bytes.
+ * @param[in] frames  Number of frames.
+ *
+ * Frame `i` of the output consists of frame `i` of each source in order.
+ */
+typedef void (*vban_interleave_units_fn)(uint8_t *dst, const uint8_t *const *src, size_t n_src, size_t unit,
+					 size_t frames);
+
+/**
+ * Weighted sum of several channels.
+ * @param[out] dst   Mixed samples.
+ * @param[in] src    Samples of each channel to be mixed.
+ * @param[in] gain   Gain of each channel.
+ * @param[in] n_src  Number of channels, or 0 for silence.
+ * @param[in] n      Number of samples.
+ */
+typedef void (*vban_mix_fn)(float *dst, const float *const *src, const float *gain, size_t n_src, size_t n);
+
+/**
+ * Largest absolute value of samples.
+ * @param[in] src  Samples.
+ * @param[in] n    Number of samples.
+ * @return         The largest absolute value, or infinity if any sample is NaN.
+ */
+typedef float (*vban_peak_fn)(const float *src, size_t n);
+
+/**
+ * Pack samples into a little-endian bit stream, the first sample in the lowest bits.
+ * @param[out] dst  Packed samples, `(n * bits + 7) / 8` bytes, the last byte padded with zero bits.
+ * @param[in] src   Samples in their lowest bits.
+ * @param[in] n     Number of samples.
+ */
+typedef void (*vban_pack_fn)(uint8_t *dst, const int16_t *src, size_t n);
+
+/**
+ * Unpack samples packed by `vban_pack_fn`.
+ * @param[out] dst  Samples shifted to the full scale of 16-bit integer.
+ * @param[in] src   Packed samples.
+ * @param[in] n     Number of samples.
+ */
+typedef void (*vban_unpack_fn)(int16_t *dst, const uint8_t *src, size_t n);
+
+struct vban_encode_kernels
+{
+	const char *name;
+	vban_quantize_fn quantize;
+	vban_interleave16x2_fn interleave16x2;
+	vban_interleave24x2_fn interleave24x2;
+	vban_interleave32x2_fn interleave32x2;
+	vban_dot_fn dot;
+	vban_interleave_units_fn interleave_units;
+	vban_mix_fn mix;
+	vban_peak_fn peak;
+	vban_pack_fn pack12;
+	vban_pack_fn pack10;
+	vban_unpack_fn unpack12;
+	vban_unpack_fn unpack10;
+};
+
+/**
+ * Select the kernels written in plain C, which the others are compared with.
+ */
+void vban_encode_kernels_portable(struct vban_encode_kernels *k);
+
+/**
+ * Select the fastest kernels supported by the CPU.
+ */
+void vban_encode_kernels_select(struct vban_encode_kernels *k);
@@ -0,0 +1,544 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <obs-module.h>
+#include <string.h>
+#include <util/darray.h>
+#include "plugin-macros.generated.h"
+#include "vban.h"
+#include "vban-encode.h"
+#include "vban-encode-simd.h"
+#include "vban-resampler.h"
+
+/* Number of frames quantized at once */
+#define BLOCK_FRAMES 256
+
+static struct vban_encode_kernels kernels;
+
+struct vban_encode_resampler_s
+{
+	vban_resampler_t *poly;
+	audio_resampler_t *obs;
+};
+
+void vban_encode_init(void)
+{
+	vban_encode_kernels_select(&kernels);
+	blog(LOG_INFO, "encoder kernels: %s", kernels.name);
+}
+
+static inline const char *skip_space(const char *s)
+{
+	while (*s == ' ' || *s == '\t')
+		s++;
+	return s;
+}
+
+/* Parses a non-negative decimal number. `strtod` is not used since it depends on the locale. */
+static bool parse_number(const char **s, double *value, bool *fraction)
+{
+	const char *p = *s;
+	double v = 0.0;
+	bool digits = false;
+
+	for (; *p >= '0' && *p <= '9'; p++, digits = true)
+		v = v * 10.0 + (*p - '0');
+
+	*fraction = *p == '.';
+	if (*fraction) {
+		double k = 0.1;
+		for (p++; *p >= '0' && *p <= '9'; p++, k *= 0.1, digits = true)
+			v += k * (*p - '0');
+	}
+
+	if (!digits)
+		return false;
+	*s = p;
+	*value = v;
+	return true;
+}
+
+/* Parses `[gain*]channel`. */
+static bool parse_term(const char **s, float *gain, size_t *src)
+{
+	const char *p = skip_space(*s);
+	double x;
+	bool fraction;
+
+	if (!parse_number(&p, &x, &fraction))
+		return false;
+
+	*gain = 1.0f;
+	p = skip_space(p);
+	if (*p == '*') {
+		*gain = (float)x;
+		p = skip_space(p + 1);
+		if (!parse_number(&p, &x, &fraction))
+			return false;
+	}
+
+	if (fraction || x < 1.0 || x > MAX_AV_PLANES)
+		return false;
+	*src = (size_t)x - 1;
+	*s = skip_space(p);
+	return true;
+}
+
+static bool parse_channel_map(struct vban_channel_map_s *map, const char *s)
+{
+	for (;;) {
+		if (map->channels >= MAX_AV_PLANES)
+			return false;
+		float *gain = map->gain[map->channels++];
+
+		for (;;) {
+			float g;
+			size_t src;
+			if (!parse_term(&s, &g, &src))
+				return false;
+			gain[src] += g;
+			if (*s != '+')
+				break;
+			s++;
+		}
+
+		if (!*s)
+			return true;
+		if (*s != ',')
+			return false;
+		s++;
+	}
+}
+
+bool vban_encode_parse_channel_map(struct vban_channel_map_s *map, const char *str)
+{
+	memset(map, 0, sizeof(struct vban_channel_map_s));
+
+	const char *s = skip_space(str ? str : "");
+	if (!*s)
+		return true;
+
+	if (!parse_channel_map(map, s)) {
+		memset(map, 0, sizeof(struct vban_channel_map_s));
+		return false;
+	}
+	return true;
+}
+
+void vban_encoder_init(struct vban_encoder_s *e, uint8_t format_bit, const struct vban_channel_map_s *map,
+		       size_t channels_src, bool dither)
+{
+	e->format_bit = format_bit;
+	e->channels = vban_channel_map_count(map, channels_src);
+	e->dither = dither && vban_encode_sample_size(format_bit) <= 2;
+	e->rng = 0x12345678;
+
+	e->mapped = e->channels != channels_src;
+	for (size_t ch = 0; ch < e->channels; ch++) {
+		size_t n = 0;
+		for (size_t src = 0; src < channels_src; src++) {
+			float gain = map->channels ? map->gain[ch][src] : (float)(src == ch);
+			if (gain != 0.0f) {
+				e->term_src[ch][n] = (uint8_t)src;
+				e->term_gain[ch][n] = gain;
+				n++;
+			}
+		}
+		e->n_terms[ch] = n;
+		if (n != 1 || e->term_src[ch][0] != ch || e->term_gain[ch][0] != 1.0f)
+			e->mapped = true;
+	}
+}
+
+/* Speaker layout of libobs with the number of channels */
+static enum speaker_layout layout_of(enum speaker_layout speakers, size_t channels)
+{
+	if (get_audio_channels(speakers) == channels)
+		return speakers;
+
+	switch (channels) {
+	case 1:
+		return SPEAKERS_MONO;
+	case 2:
+		return SPEAKERS_STEREO;
+	case 3:
+		return SPEAKERS_2POINT1;
+	case 4:
+		return SPEAKERS_4POINT0;
+	case 5:
+		return SPEAKERS_4POINT1;
+	case 6:
+		return SPEAKERS_5POINT1;
+	case 8:
+		return SPEAKERS_7POINT1;
+	default:
+		return SPEAKERS_UNKNOWN;
+	}
+}
+
+vban_encode_resampler_t *vban_encode_create_resampler(uint32_t rate_src, enum speaker_layout speakers, size_t channels,
+						      uint32_t rate_vban, int quality)
+{
+	vban_encode_resampler_t *rs = bzalloc(sizeof(struct vban_encode_resampler_s));
+
+	if (quality != VBAN_RESAMPLER_LIBOBS) {
+		rs->poly = vban_resampler_create(rate_src, rate_vban, channels, quality, kernels.dot);
+		if (rs->poly)
+			return rs;
+		blog(LOG_INFO, "built-in resampler does not support %u -> %u, using libobs", rate_src, rate_vban);
+	}
+
+	speakers = layout_of(speakers, channels);
+	if (speakers == SPEAKERS_UNKNOWN) {
+		blog(LOG_ERROR, "libobs cannot resample %d channels", (int)channels);
+		bfree(rs);
+		return NULL;
+	}
+
+	const struct resample_info src = {
+		.samples_per_sec = rate_src,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers = speakers,
+	};
+
+	const struct resample_info dst = {
+		.samples_per_sec = rate_vban,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers = speakers,
+	};
+
+	blog(LOG_INFO, "configuring resampler frequency %u -> %u", rate_src, rate_vban);
+
+	rs->obs = audio_resampler_create(&dst, &src);
+	if (!rs->obs) {
+		bfree(rs);
+		return NULL;
+	}
+	return rs;
+}
+
+void vban_encode_destroy_resampler(vban_encode_resampler_t *rs)
+{
+	if (!rs)
+		return;
+	if (rs->poly)
+		vban_resampler_destroy(rs->poly);
+	if (rs->obs)
+		audio_resampler_destroy(rs->obs);
+	bfree(rs);
+}
+
+uint64_t vban_encode_resampler_delay_ns(const vban_encode_resampler_t *rs)
+{
+	return rs->poly ? vban_resampler_delay_ns(rs->poly) : 0;
+}
+
+static inline uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* Triangular noise in the range of (-1, 1) LSB */
+static void tpdf_noise(struct vban_encoder_s *e, float *noise, size_t n)
+{
+	const float k = 1.0f / 4294967296.0f;
+	for (size_t i = 0; i < n; i++)
+		noise[i] = ((float)xorshift32(&e->rng) - (float)xorshift32(&e->rng)) * k;
+}
+
+static void interleave_int(uint8_t *dst, int32_t q[][BLOCK_FRAMES], size_t channels, size_t n, size_t fmt_size)
+{
+	if (channels == 2 && fmt_size == 2) {
+		kernels.interleave16x2(dst, q[0], q[1], n);
+		return;
+	}
+	if (channels == 2 && fmt_size == 3) {
+		kernels.interleave24x2(dst, q[0], q[1], n);
+		return;
+	}
+	if (channels == 2 && fmt_size == 4) {
+		kernels.interleave32x2(dst, q[0], q[1], n);
+		return;
+	}
+
+	// 8-bit samples are unsigned.
+	if (fmt_size == 1) {
+		for (size_t i = 0; i < n; i++) {
+			for (size_t ch = 0; ch < channels; ch++)
+				*dst++ = (uint8_t)(q[ch][i] + 128);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		for (size_t ch = 0; ch < channels; ch++) {
+			int32_t v = q[ch][i];
+			*dst++ = (uint8_t)(v & 0xFF);
+			*dst++ = (uint8_t)((v >> 8) & 0xFF);
+			if (fmt_size >= 3)
+				*dst++ = (uint8_t)((v >> 16) & 0xFF);
+			if (fmt_size >= 4)
+				*dst++ = (uint8_t)((v >> 24) & 0xFF);
+		}
+	}
+}
+
+static void interleave_float(uint8_t *dst, const float *const *planes, size_t channels, size_t offset, size_t n)
+{
+	if (channels == 2) {
+		kernels.interleave32x2(dst, planes[0] + offset, planes[1] + offset, n);
+		return;
+	}
+
+	float *d = (float *)dst;
+	for (size_t i = offset; i < offset + n; i++) {
+		for (size_t ch = 0; ch < channels; ch++)
+			*d++ = planes[ch][i];
+	}
+}
+
+/* Points each sent channel to its samples of the block at `offset`.
+ * A channel other than one input channel as it is is mixed into `mixed`. */
+static void map_block(const struct vban_encoder_s *e, const float *const *planes, size_t offset, size_t n,
+		      float mixed[][BLOCK_FRAMES], const float **src)
+{
+	for (size_t ch = 0; ch < e->channels; ch++) {
+		const size_t n_terms = e->n_terms[ch];
+		if (n_terms == 1 && e->term_gain[ch][0] == 1.0f) {
+			src[ch] = planes[e->term_src[ch][0]] + offset;
+			continue;
+		}
+
+		const float *in[MAX_AV_PLANES];
+		for (size_t k = 0; k < n_terms; k++)
+			in[k] = planes[e->term_src[ch][k]] + offset;
+		kernels.mix(mixed[ch], in, e->term_gain[ch], n_terms, n);
+		src[ch] = mixed[ch];
+	}
+}
+
+/* If `mapped` is false, `planes` are the sent channels. */
+static void encode_planar(struct vban_encoder_s *e, const float *const *planes, uint32_t frames, bool mapped,
+			  struct darray *buffer)
+{
+	const size_t channels = e->channels;
+	const size_t fmt_size = vban_encode_sample_size(e->format_bit);
+	const size_t sample_size = channels * fmt_size;
+
+	// Packed formats are quantized here and packed when sent.
+	float scale, max;
+	switch (e->format_bit) {
+	case VBAN_BITFMT_8_INT:
+		scale = 128.0f;
+		max = 127.0f;
+		break;
+	case VBAN_BITFMT_10_INT:
+		scale = 512.0f;
+		max = 511.0f;
+		break;
+	case VBAN_BITFMT_12_INT:
+		scale = 2048.0f;
+		max = 2047.0f;
+		break;
+	case VBAN_BITFMT_16_INT:
+		scale = 32768.0f;
+		max = 32767.0f;
+		break;
+	case VBAN_BITFMT_24_INT:
+		scale = 8388608.0f;
+		max = 8388607.0f;
+		break;
+	case VBAN_BITFMT_32_INT:
+		scale = 2147483648.0f;
+		max = 2147483520.0f; // The largest float below 2^31
+		break;
+	case VBAN_BITFMT_32_FLOAT:
+		scale = max = 0.0f;
+		break;
+	default:
+		blog(LOG_ERROR, "Cannot convert for format_bit=%d", (int)e->format_bit);
+		return;
+	}
+
+	size_t offset = buffer->num;
+	darray_resize(1, buffer, offset + frames * sample_size);
+	uint8_t *dst = (uint8_t *)buffer->array + offset;
+
+	if (e->format_bit == VBAN_BITFMT_32_FLOAT && !mapped) {
+		interleave_float(dst, planes, channels, 0, frames);
+		return;
+	}
+
+	/* The channel map is applied block by block in the same pass as the quantization,
+	 * so that the mixed samples are taken while they are still in the cache. */
+	int32_t q[MAX_AV_PLANES][BLOCK_FRAMES];
+	float mixed[MAX_AV_PLANES][BLOCK_FRAMES];
+	float noise[BLOCK_FRAMES];
+
+	for (uint32_t i = 0; i < frames; i += BLOCK_FRAMES) {
+		size_t n = frames - i < BLOCK_FRAMES ? frames - i : BLOCK_FRAMES;
+		const float *src[MAX_AV_PLANES];
+		if (mapped)
+			map_block(e, planes, i, n, mixed, src);
+		else {
+			for (size_t ch = 0; ch < channels; ch++)
+				src[ch] = planes[ch] + i;
+		}
+
+		if (e->format_bit == VBAN_BITFMT_32_FLOAT) {
+			interleave_float(dst, src, channels, 0, n);
+			dst += n * sample_size;
+			continue;
+		}
+
+		for (size_t ch = 0; ch < channels; ch++) {
+			if (e->dither)
+				tpdf_noise(e, noise, n);
+			kernels.quantize(q[ch], src[ch], e->dither ? noise : NULL, n, scale, max);
+		}
+		interleave_int(dst, q, channels, n, fmt_size);
+		dst += n * sample_size;
+	}
+}
+
+void vban_encode_planar(struct vban_encoder_s *e, const float *const *planes, uint32_t frames, struct darray *buffer)
+{
+	encode_planar(e, planes, frames, e->mapped, buffer);
+}
+
+void vban_encode_convert(struct vban_encoder_s *e, const struct audio_data *pkt, struct darray *buffer)
+{
+	encode_planar(e, (const float *const *)pkt->data, pkt->frames, e->mapped, buffer);
+}
+
+float vban_encode_peak(const float *const *planes, size_t channels, uint32_t frames)
+{
+	float peak = 0.0f;
+	for (size_t ch = 0; ch < channels; ch++) {
+		float p = kernels.peak(planes[ch], frames);
+		if (p > peak)
+			peak = p;
+	}
+	return peak;
+}
+
+/* `planes` are the sent channels. */
+static bool resample_planar(struct vban_encoder_s *e, vban_encode_resampler_t *resampler, const float *const *planes,
+			    uint32_t frames, struct darray *buffer)
+{
+	if (resampler->poly) {
+		const float *out[MAX_AV_PLANES] = {0};
+		uint32_t n = vban_resampler_process(resampler->poly, out, planes, frames);
+		encode_planar(e, out, n, false, buffer);
+		return true;
+	}
+
+	uint8_t *data[MAX_AV_PLANES] = {0};
+	uint32_t out_samples = 0;
+	uint64_t ts_offset = 0;
+	if (!audio_resampler_resample(resampler->obs, data, &out_samples, &ts_offset, (const uint8_t *const *)planes,
+				      frames)) {
+		blog(LOG_ERROR, "Failed to resample");
+		return false;
+	}
+
+	encode_planar(e, (const float *const *)data, out_samples, false, buffer);
+	return true;
+}
+
+bool vban_encode_resample(struct vban_encoder_s *e, vban_encode_resampler_t *resampler, const struct audio_data *pkt,
+			  struct darray *buffer)
+{
+	const float *const *planes = (const float *const *)pkt->data;
+	if (!e->mapped)
+		return resample_planar(e, resampler, planes, pkt->frames, buffer);
+
+	// Only the sent channels are resampled, mapped a block at a time.
+	float mixed[MAX_AV_PLANES][BLOCK_FRAMES];
+	for (uint32_t i = 0; i < pkt->frames; i += BLOCK_FRAMES) {
+		uint32_t n = pkt->frames - i < BLOCK_FRAMES ? pkt->frames - i : BLOCK_FRAMES;
+		const float *src[MAX_AV_PLANES];
+		map_block(e, planes, i, n, mixed, src);
+		if (!resample_planar(e, resampler, src, n, buffer))
+			return false;
+	}
+	return true;
+}
+
+enum audio_format vban_encode_interleaved_format(uint8_t format_bit)
+{
+	switch (format_bit) {
+	case VBAN_BITFMT_8_INT:
+		return AUDIO_FORMAT_U8BIT;
+	case VBAN_BITFMT_16_INT:
+		return AUDIO_FORMAT_16BIT;
+	case VBAN_BITFMT_24_INT:
+	case VBAN_BITFMT_32_INT:
+		return AUDIO_FORMAT_32BIT;
+	case VBAN_BITFMT_32_FLOAT:
+		return AUDIO_FORMAT_FLOAT;
+	default:
+		return AUDIO_FORMAT_UNKNOWN;
+	}
+}
+
+void vban_encode_interleaved(uint8_t format_bit, size_t channels, const struct audio_data *pkt, struct darray *buffer)
+{
+	const size_t fmt_size = VBanBitResolutionSize[format_bit & VBAN_BIT_RESOLUTION_MASK];
+	const size_t n = pkt->frames * channels;
+
+	size_t offset = buffer->num;
+	darray_resize(1, buffer, offset + n * fmt_size);
+	uint8_t *dst = (uint8_t *)buffer->array + offset;
+	const uint8_t *src = pkt->data[0];
+
+	if (format_bit == VBAN_BITFMT_24_INT) {
+		for (size_t i = 0; i < n; i++, src += 4) {
+			*dst++ = src[1];
+			*dst++ = src[2];
+			*dst++ = src[3];
+		}
+	}
+	else {
+		memcpy(dst, src, n * fmt_size);
+	}
+}
+
+size_t vban_encode_pack(uint8_t format_bit, uint8_t *dst, const char *const src[2], const size_t src_len[2])
+{
+	// A segment may end in the middle of a sample.
+	int16_t samples[VBAN_DATA_MAX_SIZE];
+	size_t len = src_len[0] + src_len[1];
+	if (len > sizeof(samples))
+		len = sizeof(samples);
+	size_t len0 = src_len[0] < len ? src_len[0] : len;
+	memcpy(samples, src[0], len0);
+	if (len > len0)
+		memcpy((char *)samples + len0, src[1], len - len0);
+
+	const size_t n = len / sizeof(int16_t);
+	if (vban_packed_bits(format_bit) == 12)
+		kernels.pack12(dst, samples, n);
+	else
+		kernels.pack10(dst, samples, n);
+	return vban_payload_size(format_bit, n);
+}
+
+void vban_decode_unpack(uint8_t format_bit, int16_t *dst, const char *src, size_t samples)
+{
+	if (vban_packed_bits(format_bit) == 12)
+		kernels.unpack12(dst, (const uint8_t *)src, samples);
+	else
+		kernels.unpack10(dst, (const uint8_t *)src, samples);
+}
+
+void vban_encode_interleave_units(const uint8_t *const *src, size_t n_src, size_t unit, size_t frames,
+				  struct darray *buffer)
+{
+	size_t offset = buffer->num;
+	darray_resize(1, buffer, offset + frames * n_src * unit);
+	kernels.interleave_units((uint8_t *)buffer->array + offset, src, n_src, unit, frames);
+}
@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <media-io/audio-resampler.h>
+#include "vban.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct darray;
+typedef struct vban_encode_resampler_s vban_encode_resampler_t;
+
+/**
+ * Selection and downmix of the channels to send.
+ *
+ * Each sent channel is the sum of the input channels multiplied by the gains.
+ * Zero-filled, the map sends the input channels as they are.
+ */
+struct vban_channel_map_s
+{
+	size_t channels;                          // number of sent channels, 0 to send the input ones as is
+	float gain[MAX_AV_PLANES][MAX_AV_PLANES]; // [sent channel][input channel]
+};
+
+/**
+ * Get the number of bits of a packed format.
+ * @param[in] format_bit  VBAN format.
+ * @return                12 or 10 for the packed formats, otherwise 0.
+ */
+static inline unsigned vban_packed_bits(uint8_t format_bit)
+{
+	switch (format_bit & VBAN_BIT_RESOLUTION_MASK) {
+	case VBAN_BITFMT_12_INT:
+		return 12;
+	case VBAN_BITFMT_10_INT:
+		return 10;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Get the size of an encoded sample before it is packed into a packet.
+ * @param[in] format_bit  VBAN format.
+ * @return                Size in bytes. Samples of the packed formats are held in 16 bits.
+ */
+static inline size_t vban_encode_sample_size(uint8_t format_bit)
+{
+	if (vban_packed_bits(format_bit))
+		return 2;
+	return (size_t)VBanBitResolutionSize[format_bit & VBAN_BIT_RESOLUTION_MASK];
+}
+
+/**
+ * Get the size of the payload of a packet.
+ * @param[in] format_bit  VBAN format.
+ * @param[in] samples     Number of samples, that is, frames times channels.
+ * @return                Size in bytes. Samples of the packed formats are a continuous bit stream padded to a byte.
+ */
+static inline size_t vban_payload_size(uint8_t format_bit, size_t samples)
+{
+	unsigned bits = vban_packed_bits(format_bit);
+	if (bits)
+		return (samples * bits + 7) / 8;
+	return samples * (size_t)VBanBitResolutionSize[format_bit & VBAN_BIT_RESOLUTION_MASK];
+}
+
+/**
+ * State of the encoder from planar float to interleaved VBAN samples.
+ */
+struct vban_encoder_s
+{
+	uint8_t format_bit;
+	size_t channels; // sent
+
+	/* Input channels summed into each sent channel.
+	 * A sent channel that is one input channel at unity gain refers to the input without mixing. */
+	bool mapped; // false if the sent channels are the input channels as they are
+	size_t n_terms[MAX_AV_PLANES];
+	uint8_t term_src[MAX_AV_PLANES][MAX_AV_PLANES];
+	float term_gain[MAX_AV_PLANES][MAX_AV_PLANES];
+
+	/* TPDF dither is applied to integer formats of 16 bits or fewer. */
+	bool dither;
+	uint32_t rng;
+};
+
+/**
+ * Select the encoding kernels for the CPU. Called once when the module is loaded.
+ */
+void vban_encode_init(void);
+
+/**
+ * Parse a channel map.
+ * @param[out] map  The channel map.
+ * @param[in] str   Sent channels separated by `,`, each of which is input channels separated by `+`.
+ *                  An input channel is numbered from 1 and optionally preceded by a gain and `*`,
+ *                  e.g. `1,2` or `1+0.7*3,2+0.7*3`. Empty to send the input channels as they are.
+ * @return          False if the string is malformed, in which case `map` sends the input channels as they are.
+ */
+bool vban_encode_parse_channel_map(struct vban_channel_map_s *map, const char *str);
+
+/**
+ * Get the number of channels to send.
+ * @param[in] map           The channel map.
+ * @param[in] channels_src  Number of input channels.
+ * @return                  Number of sent channels.
+ */
+static inline size_t vban_channel_map_count(const struct vban_channel_map_s *map, size_t channels_src)
+{
+	return map->channels ? map->channels : channels_src;
+}
+
+/**
+ * Initialize the encoder.
+ * @param[out] e            The encoder.
+ * @param[in] format_bit    VBAN format.
+ * @param[in] map           The channel map applied before encoding.
+ * @param[in] channels_src  Number of input channels. Gains from the other channels are ignored.
+ * @param[in] dither        True to apply TPDF dither for integer formats of 16 bits or fewer.
+ */
+void vban_encoder_init(struct vban_encoder_s *e, uint8_t format_bit, const struct vban_channel_map_s *map,
+		       size_t channels_src, bool dither);
+
+/**
+ * Create a resampler from planar float to planar float.
+ * @param[in] rate_src   Sampling rate of the input.
+ * @param[in] speakers   Speaker layout of the audio of OBS Studio.
+ * @param[in] channels   Number of channels to resample, which are the sent channels.
+ * @param[in] rate_vban  Sampling rate of the output.
+ * @param[in] quality    One of `enum vban_resampler_quality`.
+ * @return               The resampler.
+ *
+ * The built-in polyphase resampler is used unless `VBAN_RESAMPLER_LIBOBS` is
+ * requested or the ratio of the rates is not supported by it.
+ */
+vban_encode_resampler_t *vban_encode_create_resampler(uint32_t rate_src, enum speaker_layout speakers, size_t channels,
+						      uint32_t rate_vban, int quality);
+
+/**
+ * Destroy the resampler.
+ * @param[in] rs  The resampler.
+ */
+void vban_encode_destroy_resampler(vban_encode_resampler_t *rs);
+
+/**
+ * Get the delay added by the resampler.
+ * @param[in] rs  The resampler.
+ * @return        The delay in nanoseconds, or 0 if libobs resamples.
+ */
+uint64_t vban_encode_resampler_delay_ns(const vban_encode_resampler_t *rs);
+
+/**
+ * Encode planar float samples into interleaved VBAN samples.
+ * @param[in] e        The encoder.
+ * @param[in] planes   Samples of each input channel, which are mapped while being encoded.
+ * @param[in] frames   Number of frames.
+ * @param[in,out] dst  The encoded samples are appended.
+ *
+ * Integer samples are saturated at the full scale.
+ */
+void vban_encode_planar(struct vban_encoder_s *e, const float *const *planes, uint32_t frames, struct darray *dst);
+
+/**
+ * Get the largest absolute value of planar float samples.
+ * @param[in] planes    Samples of each channel.
+ * @param[in] channels  Number of channels.
+ * @param[in] frames    Number of frames.
+ * @return              The largest absolute value, or infinity if any sample is NaN.
+ */
+float vban_encode_peak(const float *const *planes, size_t channels, uint32_t frames);
+
+/**
+ * Encode an audio packet into interleaved VBAN samples.
+ * @param[in] e        The encoder.
+ * @param[in] pkt      The audio in planar float.
+ * @param[in,out] dst  The encoded samples are appended.
+ */
+void vban_encode_convert(struct vban_encoder_s *e, const struct audio_data *pkt, struct darray *dst);
+
+/**
+ * Get the interleaved format of libobs from which VBAN samples are taken without conversion.
+ * @param[in] format_bit  VBAN format.
+ * @return                The format, or `AUDIO_FORMAT_UNKNOWN` if not supported.
+ *
+ * 24-bit integer is delivered as 32-bit integer and its lowest byte is dropped.
+ */
+enum audio_format vban_encode_interleaved_format(uint8_t format_bit);
+
+/**
+ * Copy interleaved audio delivered by libobs in `vban_encode_interleaved_format` into VBAN samples.
+ * @param[in] format_bit  VBAN format.
+ * @param[in] channels    Number of channels.
+ * @param[in] pkt         The audio in one plane.
+ * @param[in,out] dst     The samples are appended.
+ */
+void vban_encode_interleaved(uint8_t format_bit, size_t channels, const struct audio_data *pkt, struct darray *dst);
+
+/**
+ * Pack encoded samples of a packed format into a payload.
+ * @param[in] format_bit  VBAN format, 12-bit or 10-bit integer.
+ * @param[out] dst        The payload, `vban_payload_size` bytes.
+ * @param[in] src         The first and the second segments of 16-bit samples from `vban_encode_planar`.
+ * @param[in] src_len     Lengths of the segments in bytes, up to `VBAN_DATA_MAX_SIZE` samples in total.
+ * @return                Size of the payload in bytes.
+ */
+size_t vban_encode_pack(uint8_t format_bit, uint8_t *dst, const char *const src[2], const size_t src_len[2]);
+
+/**
+ * Unpack received samples of a packed format.
+ * @param[in] format_bit  VBAN format, 12-bit or 10-bit integer.
+ * @param[out] dst        Samples shifted to the full scale of 16-bit integer.
+ * @param[in] src         The payload.
+ * @param[in] samples     Number of samples.
+ */
+void vban_decode_unpack(uint8_t format_bit, int16_t *dst, const char *src, size_t samples);
+
+/**
+ * Interleave encoded frames of several streams into one wider stream.
+ * @param[in] src         Encoded frames of each stream, contiguous.
+ * @param[in] n_src       Number of streams.
+ * @param[in] unit        Size of a frame of each stream in bytes.
+ * @param[in] frames      Number of frames.
+ * @param[in,out] buffer  The frames are appended.
+ */
+void vban_encode_interleave_units(const uint8_t *const *src, size_t n_src, size_t unit, size_t frames,
+				  struct darray *buffer);
+
+/**
+ * Resample an audio packet and encode it into interleaved VBAN samples.
+ * @param[in] e          The encoder.
+ * @param[in] resampler  The resampler returned by `vban_encode_create_resampler`.
+ * @param[in] pkt        The audio in planar float.
+ * @param[in,out] dst    The encoded samples are appended.
+ * @return               False if the resampler failed.
+ *
+ * The channels are mapped before resampling so that only the sent channels are resampled.
+ */
+bool vban_encode_resample(struct vban_encoder_s *e, vban_encode_resampler_t *resampler, const struct audio_data *pkt,
+			  struct darray *dst);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <obs-module.h>
+#include <string.h>
+#include "plugin-macros.generated.h"
+#include "vban-fec.h"
+#include "vban-encode.h"
+
+/* Number of recent audio packets kept by the receiver, which has to cover a group and the packets held after it */
+#define FEC_HISTORY 64
+
+static inline void xor_bytes(char *dst, const char *src, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t a, b;
+		memcpy(&a, dst + i, 8);
+		memcpy(&b, src + i, 8);
+		a ^= b;
+		memcpy(dst + i, &a, 8);
+	}
+	for (; i < n; i++)
+		dst[i] ^= src[i];
+}
+
+bool vban_fec_is_parity(const char *buf, size_t len)
+{
+	const struct VBanHeader *header = (const struct VBanHeader *)buf;
+	if (len < VBAN_HEADER_SIZE + VBAN_FEC_HEADER_SIZE)
+		return false;
+	if ((header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_USER)
+		return false;
+
+	const char *p = buf + VBAN_HEADER_SIZE;
+	return p[0] == 'F' && p[1] == 'X' && p[2] >= 1 && p[2] <= VBAN_FEC_GROUP_MAX;
+}
+
+void vban_fec_enc_reset(struct vban_fec_enc_s *e, size_t group)
+{
+	e->group = group < VBAN_FEC_GROUP_MAX ? group : VBAN_FEC_GROUP_MAX;
+	e->count = 0;
+}
+
+bool vban_fec_enc_add(struct vban_fec_enc_s *e, const struct VBanHeader *header, const char *const payload[2],
+		      const size_t payload_len[2])
+{
+	if (!e->group)
+		return false;
+
+	char *dst = e->parity + VBAN_FEC_HEADER_SIZE;
+	if (!e->count) {
+		e->first = header->nuFrame;
+		e->nbs = 0;
+		e->len = 0;
+	}
+
+	size_t len0 = payload_len[0];
+	size_t len1 = payload_len[1];
+	if (len0 + len1 > VBAN_DATA_MAX_SIZE - VBAN_FEC_HEADER_SIZE)
+		return false;
+
+	// Shorter payloads are regarded as padded with zero.
+	if (len0 + len1 > e->len) {
+		memset(dst + e->len, 0, len0 + len1 - e->len);
+		e->len = len0 + len1;
+	}
+
+	xor_bytes(dst, payload[0], len0);
+	if (len1)
+		xor_bytes(dst + len0, payload[1], len1);
+	e->nbs ^= header->format_nbs;
+
+	return ++e->count >= e->group;
+}
+
+size_t vban_fec_enc_finish(struct vban_fec_enc_s *e, struct VBanHeader *header, const char **payload)
+{
+	if (!e->count)
+		return 0;
+
+	e->parity[0] = 'F';
+	e->parity[1] = 'X';
+	e->parity[2] = (char)e->count;
+	e->parity[3] = 0;
+
+	header->format_bit = (header->format_bit & ~VBAN_CODEC_MASK) | VBAN_CODEC_USER;
+	header->format_nbs = e->nbs;
+	header->nuFrame = e->first;
+	*payload = e->parity;
+
+	e->count = 0;
+	return VBAN_FEC_HEADER_SIZE + e->len;
+}
+
+struct fec_slot
+{
+	bool valid;
+	uint32_t nuFrame;
+	uint64_t timestamp;
+	size_t len;
+	char buf[VBAN_PROTOCOL_MAX_SIZE];
+};
+
+struct vban_fec_dec_s
+{
+	vban_fec_output_cb cb;
+	void *data;
+
+	struct fec_slot slots[FEC_HISTORY];
+	bool started;
+	uint32_t next_out; // `nuFrame` of the next packet to output
+	uint32_t last_in;  // the newest `nuFrame` received
+	size_t group;      // the largest group seen
+
+	// statistics
+	uint64_t cnt_recovered;
+	uint64_t cnt_unrecoverable;
+};
+
+static inline struct fec_slot *slot_of(vban_fec_dec_t *d, uint32_t nu_frame)
+{
+	return d->slots + nu_frame % FEC_HISTORY;
+}
+
+static inline bool has(vban_fec_dec_t *d, uint32_t nu_frame)
+{
+	const struct fec_slot *s = slot_of(d, nu_frame);
+	return s->valid && s->nuFrame == nu_frame;
+}
+
+static inline uint64_t packet_ns(const char *buf)
+{
+	const struct VBanHeader *header = (const struct VBanHeader *)buf;
+	return ((uint64_t)header->format_nbs + 1) * 1000000000 / VBanSRList[header->format_SR & VBAN_SR_MASK];
+}
+
+vban_fec_dec_t *vban_fec_dec_create(vban_fec_output_cb cb, void *data)
+{
+	vban_fec_dec_t *d = bzalloc(sizeof(struct vban_fec_dec_s));
+	d->cb = cb;
+	d->data = data;
+	return d;
+}
+
+void vban_fec_dec_destroy(vban_fec_dec_t *d)
+{
+	bfree(d);
+}
+
+/* Outputs the packets in order. A lost packet is waited for until the packet following its group arrives,
+ * since the parity packet is sent right after the group. */
+static void flush(vban_fec_dec_t *d)
+{
+	while ((int32_t)(d->last_in - d->next_out) >= 0) {
+		if (has(d, d->next_out)) {
+			const struct fec_slot *s = slot_of(d, d->next_out);
+			d->cb(d->data, s->buf, s->len, s->timestamp);
+		}
+		else if (d->last_in - d->next_out <= d->group) {
+			return;
+		}
+		else {
+			d->cnt_unrecoverable++;
+		}
+		d->next_out++;
+	}
+}
+
+void vban_fec_dec_audio(vban_fec_dec_t *d, const char *buf, size_t len, uint64_t timestamp)
+{
+	uint32_t nu_frame = ((const struct VBanHeader *)buf)->nuFrame;
+
+	if (!d->started) {
+		d->started = true;
+		d->next_out = d->last_in = nu_frame;
+	}
+
+	// Already output, given up, or duplicated
+	if ((int32_t)(nu_frame - d->next_out) < 0 || has(d, nu_frame))
+		return;
+
+	// The sender restarted or too many packets were lost; the held packets are output as they are.
+	if (nu_frame - d->next_out >= FEC_HISTORY) {
+		for (; (int32_t)(d->last_in - d->next_out) >= 0; d->next_out++) {
+			if (has(d, d->next_out)) {
+				const struct fec_slot *s = slot_of(d, d->next_out);
+				d->cb(d->data, s->buf, s->len, s->timestamp);
+			}
+		}
+		d->next_out = d->last_in = nu_frame;
+	}
+
+	struct fec_slot *s = slot_of(d, nu_frame);
+	memcpy(s->buf, buf, len);
+	s->len = len;
+	s->nuFrame = nu_frame;
+	s->timestamp = timestamp;
+	s->valid = true;
+
+	if ((int32_t)(nu_frame - d->last_in) > 0)
+		d->last_in = nu_frame;
+
+	flush(d);
+}
+
+/* The timestamp of a reconstructed packet is taken from the nearest packet received. */
+static uint64_t recovered_timestamp(vban_fec_dec_t *d, uint32_t nu_frame, uint64_t duration_ns)
+{
+	for (uint32_t f = nu_frame + 1; (int32_t)(d->last_in - f) >= 0; f++) {
+		if (has(d, f))
+			return slot_of(d, f)->timestamp - (f - nu_frame) * duration_ns;
+	}
+	for (uint32_t f = nu_frame - 1; (int32_t)(f - d->next_out) >= 0; f--) {
+		if (has(d, f))
+			return slot_of(d, f)->timestamp + (nu_frame - f) * duration_ns;
+	}
+	return 0;
+}
+
+void vban_fec_dec_parity(vban_fec_dec_t *d, const char *buf, size_t len)
+{
+	const struct VBanHeader *header = (const struct VBanHeader *)buf;
+	const char *parity = buf + VBAN_HEADER_SIZE + VBAN_FEC_HEADER_SIZE;
+	const size_t parity_len = len - VBAN_HEADER_SIZE - VBAN_FEC_HEADER_SIZE;
+	const size_t n = (size_t)buf[VBAN_HEADER_SIZE + 2];
+
+	if (n > d->group)
+		d->group = n;
+	if (!d->started)
+		return;
+
+	// Only one lost packet can be reconstructed in each group.
+	uint32_t missing = 0;
+	size_t n_missing = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (!has(d, header->nuFrame + (uint32_t)i)) {
+			missing = header->nuFrame + (uint32_t)i;
+			n_missing++;
+		}
+	}
+	if (n_missing != 1 || (int32_t)(missing - d->next_out) < 0 || missing - d->next_out >= FEC_HISTORY)
+		return;
+
+	struct fec_slot *r = slot_of(d, missing);
+	struct VBanHeader *rh = (struct VBanHeader *)r->buf;
+	char *dst = r->buf + VBAN_HEADER_SIZE;
+	r->valid = false;
+
+	// A group of one packet is a duplicate.
+	memcpy(rh, header, VBAN_HEADER_SIZE);
+	rh->format_bit &= ~VBAN_CODEC_MASK;
+	uint8_t nbs = header->format_nbs;
+	memcpy(dst, parity, parity_len);
+
+	for (size_t i = 0; i < n; i++) {
+		uint32_t f = header->nuFrame + (uint32_t)i;
+		if (f == missing)
+			continue;
+		const struct fec_slot *s = slot_of(d, f);
+		size_t l = s->len - VBAN_HEADER_SIZE;
+		xor_bytes(dst, s->buf + VBAN_HEADER_SIZE, l < parity_len ? l : parity_len);
+		nbs ^= ((const struct VBanHeader *)s->buf)->format_nbs;
+		memcpy(rh, s->buf, VBAN_HEADER_SIZE);
+	}
+
+	rh->nuFrame = missing;
+	rh->format_nbs = nbs;
+	size_t payload_len = vban_payload_size(rh->format_bit, ((size_t)nbs + 1) * ((size_t)rh->format_nbc + 1));
+	if (payload_len > parity_len)
+		return;
+
+	r->len = VBAN_HEADER_SIZE + payload_len;
+	r->nuFrame = missing;
+	r->timestamp = recovered_timestamp(d, missing, packet_ns(r->buf));
+	r->valid = true;
+	d->cnt_recovered++;
+
+	if ((int32_t)(missing - d->last_in) > 0)
+		d->last_in = missing;
+
+	flush(d);
+}
+
+void vban_fec_dec_stats(const vban_fec_dec_t *d, uint64_t *recovered, uint64_t *unrecoverable)
+{
+	*recovered = d->cnt_recovered;
+	*unrecoverable = d->cnt_unrecoverable;
+}
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vban.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Forward error correction by XOR parity.
+ *
+ * After each group of audio packets, the output sends a parity packet whose
+ * payload is the XOR of the payloads of the group, each zero-padded to the
+ * longest one. The parity packet has the stream name of the group and
+ * `VBAN_CODEC_USER` so that regular receivers ignore it.
+ * Its `nuFrame` is that of the first packet of the group and its `format_nbs`
+ * is the XOR of those of the group. The payload starts with
+ * `VBAN_FEC_HEADER_SIZE` bytes holding a magic and the number of packets.
+ * A receiver can reconstruct one lost packet in each group.
+ */
+
+#define VBAN_FEC_HEADER_SIZE 4
+
+/* Largest number of audio packets protected by one parity packet */
+#define VBAN_FEC_GROUP_MAX 16
+
+struct vban_fec_enc_s
+{
+	size_t group; // number of packets in a group, 0 if disabled
+	size_t count; // packets added to the current group
+	uint32_t first;
+	uint8_t nbs;
+	size_t len; // longest payload in the group
+	char parity[VBAN_FEC_HEADER_SIZE + VBAN_DATA_MAX_SIZE];
+};
+
+/**
+ * Check whether a packet is a parity packet.
+ * @param[in] buf  The packet.
+ * @param[in] len  Length of the packet in bytes.
+ * @return         True if the packet is a parity packet.
+ */
+bool vban_fec_is_parity(const char *buf, size_t len);
+
+/**
+ * Start over with the group size.
+ * @param[out] e     The encoder.
+ * @param[in] group  Number of audio packets protected by one parity packet, 0 to disable.
+ */
+void vban_fec_enc_reset(struct vban_fec_enc_s *e, size_t group);
+
+/**
+ * Add an audio packet to the group.
+ * @param[in,out] e        The encoder.
+ * @param[in] header       The header of the packet.
+ * @param[in] payload      The first and the second segments of the payload.
+ * @param[in] payload_len  Lengths of the segments in bytes, up to `VBAN_DATA_MAX_SIZE - VBAN_FEC_HEADER_SIZE` in total.
+ * @return                 True if the group is complete and the parity packet has to be sent.
+ */
+bool vban_fec_enc_add(struct vban_fec_enc_s *e, const struct VBanHeader *header, const char *const payload[2],
+		      const size_t payload_len[2]);
+
+/**
+ * Make the parity packet of the packets added so far and start the next group.
+ * @param[in,out] e      The encoder.
+ * @param[in,out] header The header of the audio packets, which is modified for the parity packet.
+ * @param[out] payload   The payload, which stays valid until the next call of `vban_fec_enc_add`.
+ * @return               Length of the payload, or 0 if no packet was added.
+ */
+size_t vban_fec_enc_finish(struct vban_fec_enc_s *e, struct VBanHeader *header, const char **payload);
+
+typedef struct vban_fec_dec_s vban_fec_dec_t;
+
+/**
+ * Called for each audio packet in order of `nuFrame`.
+ * @param[in] data       The pointer given to `vban_fec_dec_create`.
+ * @param[in] buf        The packet, received or reconstructed.
+ * @param[in] len        Length of the packet in bytes.
+ * @param[in] timestamp  Timestamp of the first sample.
+ *
+ * Packets that could not be reconstructed are skipped, which leaves a gap in `nuFrame`.
+ */
+typedef void (*vban_fec_output_cb)(void *data, const char *buf, size_t len, uint64_t timestamp);
+
+/**
+ * Create a receiver that reconstructs lost audio packets.
+ * @param[in] cb    The callback to output the packets.
+ * @param[in] data  The pointer passed to the callback.
+ * @return          The receiver.
+ */
+vban_fec_dec_t *vban_fec_dec_create(vban_fec_output_cb cb, void *data);
+
+/**
+ * Destroy the receiver. Packets waiting for a parity packet are discarded.
+ * @param[in] d  The receiver.
+ */
+void vban_fec_dec_destroy(vban_fec_dec_t *d);
+
+/**
+ * Receive an audio packet.
+ * @param[in] d          The receiver.
+ * @param[in] buf        The packet.
+ * @param[in] len        Length of the packet in bytes.
+ * @param[in] timestamp  Timestamp of the first sample.
+ *
+ * After a lost packet, the following packets are held until the parity packet of the group arrives
+ * or until it cannot arrive anymore.
+ */
+void vban_fec_dec_audio(vban_fec_dec_t *d, const char *buf, size_t len, uint64_t timestamp);
+
+/**
+ * Receive a parity packet.
+ * @param[in] d    The receiver.
+ * @param[in] buf  The packet, checked by `vban_fec_is_parity`.
+ * @param[in] len  Length of the packet in bytes.
+ */
+void vban_fec_dec_parity(vban_fec_dec_t *d, const char *buf, size_t len);
+
+/**
+ * Get the statistics.
+ * @param[in] d               The receiver.
+ * @param[out] recovered      Number of packets reconstructed.
+ * @param[out] unrecoverable  Number of packets lost in spite of the parity.
+ */
+void vban_fec_dec_stats(const vban_fec_dec_t *d, uint64_t *recovered, uint64_t *unrecoverable);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
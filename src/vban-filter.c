@@ -47,7 +47,8 @@ static obs_properties_t *vban_flt_get_properties(void *data)
 	struct vban_flt_s *s = data;
 	obs_properties_t *props = vban_output_info.get_properties(s ? s->output : NULL);
 
-	obs_properties_remove_by_name(props, "mixer");
+	obs_properties_remove_by_name(props, "tracks");
+	obs_properties_add_bool(props, "inline_send", obs_module_text("VBAN.flt.prop.inline_send"));
 
 	return props;
 }
@@ -88,7 +89,15 @@ static struct obs_audio_data *vban_flt_audio(void *data, struct obs_audio_data *
 	for (size_t i = 0; i < o->channels; i++)
 		frames.data[i] = audio->data[i];
 
-	vban_output_info.raw_audio(s->output, &frames);
+	if (!vban_out_audio_enter(o))
+		return audio;
+
+	// Sent without waking the worker if possible, otherwise queued for the worker.
+	struct output_thread_s *stream = o->n_tracks ? o->tracks[0].stream : NULL;
+	if (!stream || !vban_out_stream_inline(stream, &frames))
+		vban_output_info.raw_audio(s->output, &frames);
+
+	vban_out_audio_leave(o);
 
 	return audio;
 }
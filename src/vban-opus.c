@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <obs-module.h>
+#include <string.h>
+#include "plugin-macros.generated.h"
+#include "vban-opus.h"
+
+#ifdef HAVE_OPUS
+#include <opus_multistream.h>
+#endif
+
+size_t vban_opus_frame_samples(int rate, size_t nbs_max)
+{
+	// 20, 10, 5 and 2.5 ms; `format_nbs` holds up to 256 samples.
+	const int divs[] = {50, 100, 200};
+	for (size_t i = 0; i < sizeof(divs) / sizeof(*divs); i++) {
+		size_t frames = (size_t)(rate / divs[i]);
+		if (frames <= nbs_max && frames <= 256)
+			return frames;
+	}
+	return (size_t)(rate / 400);
+}
+
+#ifdef HAVE_OPUS
+
+/* The channels are paired in order into coupled streams. */
+static void stream_layout(size_t channels, int *streams, int *coupled, unsigned char *mapping)
+{
+	*coupled = (int)(channels / 2);
+	*streams = (int)channels - *coupled;
+	for (size_t i = 0; i < channels; i++)
+		mapping[i] = (unsigned char)i;
+}
+
+struct vban_opus_enc_s
+{
+	OpusMSEncoder *ms;
+	size_t channels;
+	size_t frames;
+	float *pcm; // one frame, interleaved
+	char payload[VBAN_DATA_MAX_SIZE];
+};
+
+vban_opus_enc_t *vban_opus_enc_create(int rate, size_t channels, size_t frames, int bitrate)
+{
+	if (channels < 1 || channels > 255)
+		return NULL;
+
+	int streams, coupled, err;
+	unsigned char mapping[255];
+	stream_layout(channels, &streams, &coupled, mapping);
+
+	// The restricted low-delay mode drops the speech tools and their extra look-ahead.
+	OpusMSEncoder *ms = opus_multistream_encoder_create(rate, (int)channels, streams, coupled, mapping,
+							   OPUS_APPLICATION_RESTRICTED_LOWDELAY, &err);
+	if (!ms) {
+		blog(LOG_ERROR, "vban-opus: cannot create an encoder for %d channels at %d Hz: %s", (int)channels, rate,
+		     opus_strerror(err));
+		return NULL;
+	}
+	opus_multistream_encoder_ctl(ms, OPUS_SET_BITRATE((opus_int32)(bitrate * (int)channels)));
+
+	vban_opus_enc_t *e = bzalloc(sizeof(struct vban_opus_enc_s));
+	e->ms = ms;
+	e->channels = channels;
+	e->frames = frames;
+	e->pcm = bzalloc(frames * channels * sizeof(float));
+	e->payload[0] = 'O';
+	e->payload[1] = 'P';
+	return e;
+}
+
+void vban_opus_enc_destroy(vban_opus_enc_t *e)
+{
+	if (!e)
+		return;
+	opus_multistream_encoder_destroy(e->ms);
+	bfree(e->pcm);
+	bfree(e);
+}
+
+size_t vban_opus_enc_encode(vban_opus_enc_t *e, const char *const src[2], const size_t src_len[2],
+			    const char **payload)
+{
+	const size_t frame_bytes = e->frames * e->channels * sizeof(float);
+	char *pcm = (char *)e->pcm;
+	size_t n = 0;
+	for (int i = 0; i < 2 && n < frame_bytes; i++) {
+		size_t l = src_len[i] < frame_bytes - n ? src_len[i] : frame_bytes - n;
+		if (l)
+			memcpy(pcm + n, src[i], l);
+		n += l;
+	}
+	if (n < frame_bytes)
+		memset(pcm + n, 0, frame_bytes - n);
+
+	opus_int32 ret = opus_multistream_encode_float(e->ms, e->pcm, (int)e->frames,
+						       (unsigned char *)e->payload + VBAN_OPUS_HEADER_SIZE,
+						       VBAN_DATA_MAX_SIZE - VBAN_OPUS_HEADER_SIZE);
+	if (ret < 0) {
+		blog(LOG_ERROR, "vban-opus: encoding failed: %s", opus_strerror(ret));
+		return 0;
+	}
+
+	*payload = e->payload;
+	return VBAN_OPUS_HEADER_SIZE + (size_t)ret;
+}
+
+struct vban_opus_dec_s
+{
+	OpusMSDecoder *ms;
+};
+
+vban_opus_dec_t *vban_opus_dec_create(int rate, size_t channels)
+{
+	if (channels < 1 || channels > 255)
+		return NULL;
+
+	int streams, coupled, err;
+	unsigned char mapping[255];
+	stream_layout(channels, &streams, &coupled, mapping);
+
+	OpusMSDecoder *ms = opus_multistream_decoder_create(rate, (int)channels, streams, coupled, mapping, &err);
+	if (!ms) {
+		blog(LOG_ERROR, "vban-opus: cannot create a decoder for %d channels at %d Hz: %s", (int)channels, rate,
+		     opus_strerror(err));
+		return NULL;
+	}
+
+	vban_opus_dec_t *d = bzalloc(sizeof(struct vban_opus_dec_s));
+	d->ms = ms;
+	return d;
+}
+
+void vban_opus_dec_destroy(vban_opus_dec_t *d)
+{
+	if (!d)
+		return;
+	opus_multistream_decoder_destroy(d->ms);
+	bfree(d);
+}
+
+bool vban_opus_dec_decode(vban_opus_dec_t *d, const char *buf, size_t len, size_t frames, float *pcm)
+{
+	const unsigned char *data = NULL;
+	opus_int32 data_len = 0;
+	if (buf) {
+		data = (const unsigned char *)buf + VBAN_HEADER_SIZE + VBAN_OPUS_HEADER_SIZE;
+		data_len = (opus_int32)(len - VBAN_HEADER_SIZE - VBAN_OPUS_HEADER_SIZE);
+	}
+
+	int ret = opus_multistream_decode_float(d->ms, data, data_len, pcm, (int)frames, 0);
+	if (ret < 0) {
+		blog(LOG_ERROR, "vban-opus: decoding failed: %s", opus_strerror(ret));
+		return false;
+	}
+	return (size_t)ret == frames;
+}
+
+#endif // HAVE_OPUS
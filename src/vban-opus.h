@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vban.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Opus compressed audio carried in VBAN packets.
+ *
+ * Each packet holds one Opus frame under `VBAN_CODEC_USER` so that regular
+ * receivers ignore it. The payload starts with `VBAN_OPUS_HEADER_SIZE` bytes
+ * holding a magic, followed by the Opus packet of a multistream encoder whose
+ * channels are paired into coupled streams in order, the last one uncoupled
+ * if the number of channels is odd.
+ * `format_SR`, `format_nbc` and `format_nbs` of the header describe the
+ * decoded audio.
+ */
+
+#define VBAN_OPUS_HEADER_SIZE 4
+
+/**
+ * Check whether a packet is an Opus packet.
+ * @param[in] buf  The packet.
+ * @param[in] len  Length of the packet in bytes.
+ * @return         True if the packet is an Opus packet.
+ */
+static inline bool vban_opus_is_packet(const char *buf, size_t len)
+{
+	const struct VBanHeader *header = (const struct VBanHeader *)buf;
+	if (len < VBAN_HEADER_SIZE + VBAN_OPUS_HEADER_SIZE)
+		return false;
+	if ((header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_USER)
+		return false;
+
+	const char *p = buf + VBAN_HEADER_SIZE;
+	return p[0] == 'O' && p[1] == 'P' && p[2] == 0;
+}
+
+/**
+ * Check whether Opus can encode at the sampling rate.
+ * @param[in] rate  Sampling rate.
+ * @return          True if the rate is one of 8, 12, 16, 24 and 48 kHz.
+ */
+static inline bool vban_opus_rate_supported(int rate)
+{
+	return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 || rate == 48000;
+}
+
+/**
+ * Choose the frame size.
+ * @param[in] rate     Sampling rate, supported by Opus.
+ * @param[in] nbs_max  Largest number of samples per packet.
+ * @return             The longest frame of 2.5, 5, 10 or 20 ms that fits in `nbs_max` and in `format_nbs`,
+ *                     at least 2.5 ms.
+ */
+size_t vban_opus_frame_samples(int rate, size_t nbs_max);
+
+typedef struct vban_opus_enc_s vban_opus_enc_t;
+typedef struct vban_opus_dec_s vban_opus_dec_t;
+
+#ifdef HAVE_OPUS
+
+/**
+ * Create an encoder.
+ * @param[in] rate      Sampling rate, supported by Opus.
+ * @param[in] channels  Number of channels.
+ * @param[in] frames    Number of samples in each frame, returned by `vban_opus_frame_samples`.
+ * @param[in] bitrate   Bitrate of each channel in bits per second.
+ * @return              The encoder, or NULL on failure.
+ */
+vban_opus_enc_t *vban_opus_enc_create(int rate, size_t channels, size_t frames, int bitrate);
+
+/**
+ * Destroy the encoder.
+ * @param[in] e  The encoder.
+ */
+void vban_opus_enc_destroy(vban_opus_enc_t *e);
+
+/**
+ * Encode a frame.
+ * @param[in] e          The encoder.
+ * @param[in] src        The first and the second segments of interleaved 32-bit float samples.
+ * @param[in] src_len    Lengths of the segments in bytes, up to one frame in total.
+ *                       A shorter input is padded with silence.
+ * @param[out] payload   The payload, which stays valid until the next call.
+ * @return               Length of the payload including the magic, or 0 on failure.
+ */
+size_t vban_opus_enc_encode(vban_opus_enc_t *e, const char *const src[2], const size_t src_len[2],
+			    const char **payload);
+
+/**
+ * Create a decoder.
+ * @param[in] rate      Sampling rate, supported by Opus.
+ * @param[in] channels  Number of channels.
+ * @return              The decoder, or NULL on failure.
+ */
+vban_opus_dec_t *vban_opus_dec_create(int rate, size_t channels);
+
+/**
+ * Destroy the decoder.
+ * @param[in] d  The decoder.
+ */
+void vban_opus_dec_destroy(vban_opus_dec_t *d);
+
+/**
+ * Decode a packet, or conceal a lost packet.
+ * @param[in] d        The decoder.
+ * @param[in] buf      The packet checked by `vban_opus_is_packet`, or NULL to conceal a lost packet.
+ * @param[in] len      Length of the packet in bytes.
+ * @param[in] frames   Number of samples to produce.
+ * @param[out] pcm     Interleaved samples, `frames` times the channels.
+ * @return             True on success.
+ */
+bool vban_opus_dec_decode(vban_opus_dec_t *d, const char *buf, size_t len, size_t frames, float *pcm);
+
+#else // HAVE_OPUS
+
+static inline vban_opus_enc_t *vban_opus_enc_create(int rate, size_t channels, size_t frames, int bitrate)
+{
+	(void)rate, (void)channels, (void)frames, (void)bitrate;
+	return NULL;
+}
+
+static inline void vban_opus_enc_destroy(vban_opus_enc_t *e)
+{
+	(void)e;
+}
+
+static inline size_t vban_opus_enc_encode(vban_opus_enc_t *e, const char *const src[2], const size_t src_len[2],
+					  const char **payload)
+{
+	(void)e, (void)src, (void)src_len, (void)payload;
+	return 0;
+}
+
+static inline vban_opus_dec_t *vban_opus_dec_create(int rate, size_t channels)
+{
+	(void)rate, (void)channels;
+	return NULL;
+}
+
+static inline void vban_opus_dec_destroy(vban_opus_dec_t *d)
+{
+	(void)d;
+}
+
+static inline bool vban_opus_dec_decode(vban_opus_dec_t *d, const char *buf, size_t len, size_t frames, float *pcm)
+{
+	(void)d, (void)buf, (void)len, (void)frames, (void)pcm;
+	return false;
+}
+
+#endif // HAVE_OPUS
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/darray.h>
+#ifdef __linux__
+#include <time.h>
+#include <errno.h>
+#endif
+#include "plugin-macros.generated.h"
+#include "vban-output-internal.h"
+#include "vban-send.h"
+#include "vban-out-sched.h"
+
+/* Number of worker threads, which does not depend on the number of outputs */
+#define VBAN_SCHED_WORKERS 2
+
+/* When the socket buffer is full, the packets are kept and sent again by this many rounds, each after waiting for the
+ * buffer up to this time, before being dropped. The wait is done with the streams unlocked so that it does not hold
+ * back the inline path and the updates. A blocking socket would hold back the streams of all outputs instead. */
+#define SEND_RETRY_MAX 3
+#define SEND_RETRY_WAIT_MS 1
+
+/* Waits shorter than this are done by sleeping precisely instead of waiting for the event. */
+#define PRECISE_SLEEP_NS (2 * 1000000LL)
+
+struct sched_worker_s
+{
+	int index;
+	pthread_t thread;
+	bool running;
+	volatile bool cont;
+
+	// Created at the first start and kept so that the audio thread can signal it at any time.
+	os_event_t *event;
+
+	// Protects `streams`, `rr`, and `send`
+	pthread_mutex_t mutex;
+	DARRAY(struct output_thread_s *) streams;
+	size_t rr;
+	struct vban_send_s send;
+
+	// statistics
+	uint64_t cnt_rounds;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct sched_worker_s workers[VBAN_SCHED_WORKERS];
+static bool initialized = false;
+
+static void sleepto_ns(uint64_t target_ns)
+{
+#ifdef __linux__
+	// `os_gettime_ns` is based on CLOCK_MONOTONIC on Linux.
+	struct timespec ts = {
+		.tv_sec = (time_t)(target_ns / 1000000000),
+		.tv_nsec = (long)(target_ns % 1000000000),
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+#else
+	os_sleepto_ns(target_ns);
+#endif
+}
+
+static inline uint64_t earliest(uint64_t a, uint64_t b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	return a < b ? a : b;
+}
+
+/* Waits until `wake_ns` or until the event is signaled. Without `wake_ns`, waits for the event. */
+static void worker_wait(struct sched_worker_s *w, uint64_t wake_ns)
+{
+	if (!wake_ns) {
+		os_event_timedwait(w->event, 100);
+		return;
+	}
+
+	uint64_t now = os_gettime_ns();
+	if (wake_ns <= now)
+		return;
+
+	if (wake_ns - now > PRECISE_SLEEP_NS) {
+		unsigned long ms = (unsigned long)((wake_ns - now - PRECISE_SLEEP_NS / 2) / 1000000);
+		if (os_event_timedwait(w->event, ms) == 0)
+			return;
+	}
+
+	sleepto_ns(wake_ns);
+}
+
+static void *worker_main(void *data)
+{
+	struct sched_worker_s *w = data;
+	os_set_thread_name("vban-out");
+
+	uint64_t wake_ns = 0;
+	while (w->cont) {
+		worker_wait(w, wake_ns);
+		wake_ns = 0;
+
+		pthread_mutex_lock(&w->mutex);
+
+		// Packets kept from the previous round are counted to any stream when flushed, so all are locked first.
+		size_t n = w->streams.num;
+		for (size_t i = 0; i < n; i++)
+			vban_out_stream_lock(w->streams.array[i]);
+
+		// Start from a different stream in each round so that no stream always goes first.
+		for (size_t i = 0; i < n; i++) {
+			struct output_thread_s *t = w->streams.array[(w->rr + i) % n];
+			wake_ns = earliest(wake_ns, vban_out_stream_step(t));
+		}
+		w->rr++;
+		w->cnt_rounds++;
+
+		// The queued packets refer to the buffers of the streams, which stay locked until sent.
+		// Packets that do not fit the socket buffer are kept with their payloads copied.
+		vban_send_flush(&w->send);
+
+		// SO_TXTIME is cleared from the shared socket once no stream wants it.
+		bool txtime = false;
+		for (size_t i = 0; i < n && !txtime; i++)
+			txtime = vban_out_stream_wants_txtime(w->streams.array[i]);
+		if (!txtime && w->send.txtime)
+			vban_send_set_txtime(&w->send, false);
+
+		for (size_t i = 0; i < n; i++)
+			vban_out_stream_unlock(w->streams.array[i]);
+
+		if (w->send.n_pkts) {
+			// The next round sends them after the buffer has space or the wait times out.
+			vban_send_wait(&w->send);
+			wake_ns = os_gettime_ns();
+		}
+
+		pthread_mutex_unlock(&w->mutex);
+	}
+
+	return NULL;
+}
+
+static bool worker_start(struct sched_worker_s *w)
+{
+	if (!vban_send_open(&w->send))
+		return false;
+
+	// Packets of all streams in a round are submitted together.
+	vban_send_set_batch(&w->send, true);
+	vban_send_set_nonblock(&w->send, true);
+	vban_send_set_retry(&w->send, SEND_RETRY_MAX, SEND_RETRY_WAIT_MS);
+	vban_send_set_keep(&w->send, true);
+
+	w->cnt_rounds = 0;
+	w->cont = true;
+	if (pthread_create(&w->thread, NULL, worker_main, w)) {
+		blog(LOG_ERROR, "vban-sched: failed to create worker %d", w->index);
+		vban_send_close(&w->send);
+		return false;
+	}
+
+	w->running = true;
+	blog(LOG_INFO, "vban-sched: worker %d started", w->index);
+	return true;
+}
+
+static void worker_stop(struct sched_worker_s *w)
+{
+	w->cont = false;
+	os_event_signal(w->event);
+	pthread_join(w->thread, NULL);
+	w->running = false;
+
+	blog(LOG_INFO, "vban-sched: worker %d stopped after %" PRIu64 " rounds", w->index, w->cnt_rounds);
+	if (w->send.cnt_txtime_errors)
+		blog(LOG_WARNING, "vban-sched: the qdisc reported %" PRIu64 " errors on the departure time",
+		     w->send.cnt_txtime_errors);
+
+	vban_send_close(&w->send);
+}
+
+static void init_unlocked(void)
+{
+	if (initialized)
+		return;
+
+	for (int i = 0; i < VBAN_SCHED_WORKERS; i++) {
+		struct sched_worker_s *w = workers + i;
+		w->index = i;
+		os_event_init(&w->event, OS_EVENT_TYPE_AUTO);
+		pthread_mutex_init(&w->mutex, NULL);
+		da_init(w->streams);
+	}
+	initialized = true;
+}
+
+bool vban_sched_add(struct vban_out_s *v)
+{
+	pthread_mutex_lock(&mutex);
+	init_unlocked();
+
+	// All tracks of an output go to the same worker so that they are sent in the same rounds.
+	struct sched_worker_s *w = workers;
+	for (int i = 1; i < VBAN_SCHED_WORKERS; i++) {
+		if (workers[i].streams.num < w->streams.num)
+			w = workers + i;
+	}
+
+	if (!w->running && !worker_start(w)) {
+		pthread_mutex_unlock(&mutex);
+		return false;
+	}
+
+	pthread_mutex_lock(&w->mutex);
+	bool ok = true;
+	if (v->aggregated) {
+		struct output_thread_s *t = vban_out_stream_create_aggregate(v, &w->send);
+		if (t) {
+			da_push_back(w->streams, &t);
+			v->tracks[0].stream = t;
+		}
+		else {
+			ok = false;
+		}
+	}
+	for (size_t i = 0; i < v->n_tracks && ok && !v->aggregated; i++) {
+		struct output_thread_s *t = vban_out_stream_create(v, v->tracks + i, &w->send);
+		if (t) {
+			da_push_back(w->streams, &t);
+			v->tracks[i].stream = t;
+		}
+		else {
+			ok = false;
+		}
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	if (ok) {
+		v->wake = w->event;
+		os_event_signal(w->event);
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	if (!ok)
+		vban_sched_remove(v);
+
+	return ok;
+}
+
+void vban_sched_remove(struct vban_out_s *v)
+{
+	pthread_mutex_lock(&mutex);
+
+	for (int i = 0; i < VBAN_SCHED_WORKERS; i++) {
+		struct sched_worker_s *w = workers + i;
+		bool found = false;
+
+		pthread_mutex_lock(&w->mutex);
+		for (size_t j = 0; j < v->n_tracks; j++) {
+			struct output_thread_s *t = v->tracks[j].stream;
+			size_t idx = t ? da_find(w->streams, &t, 0) : DARRAY_INVALID;
+			if (idx == DARRAY_INVALID)
+				continue;
+			if (!found) {
+				// Queued and kept packets refer to the buffers and the statistics of the streams.
+				vban_send_set_keep(&w->send, false);
+				vban_send_flush(&w->send);
+				vban_send_set_keep(&w->send, true);
+				found = true;
+			}
+			da_erase(w->streams, idx);
+		}
+		pthread_mutex_unlock(&w->mutex);
+
+		if (w->running && !w->streams.num)
+			worker_stop(w);
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	for (size_t j = 0; j < v->n_tracks; j++) {
+		if (v->tracks[j].stream)
+			vban_out_stream_destroy(v->tracks[j].stream);
+		v->tracks[j].stream = NULL;
+	}
+}
+
+void vban_sched_free(void)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (initialized) {
+		for (int i = 0; i < VBAN_SCHED_WORKERS; i++) {
+			struct sched_worker_s *w = workers + i;
+			if (w->running)
+				worker_stop(w);
+			da_free(w->streams);
+			pthread_mutex_destroy(&w->mutex);
+			os_event_destroy(w->event);
+		}
+		initialized = false;
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Process-wide transmit scheduler.
+ *
+ * A fixed number of worker threads, each with one UDP socket, process the
+ * streams of all VBAN outputs and filters. A stream is assigned to the
+ * worker with the fewest streams. In each round, the worker steps every
+ * stream once, starting from a different stream each time, and submits the
+ * packets of all streams together.
+ */
+
+struct vban_out_s;
+
+/**
+ * Register the tracks of the output as streams on one worker.
+ * @param[in] v  The output, whose rings of the tracks are already created.
+ * @return       True if succeeded.
+ *
+ * `stream` of each track and `v->wake` are set.
+ */
+bool vban_sched_add(struct vban_out_s *v);
+
+/**
+ * Unregister the output. The streams are destroyed.
+ * @param[in] v  The output.
+ */
+void vban_sched_remove(struct vban_out_s *v);
+
+/**
+ * Release the resources of the scheduler. Called when the module is unloaded.
+ */
+void vban_sched_free(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -1,16 +1,52 @@
 #pragma once
 
 #include <util/threading.h>
-#if LIBOBS_API_VER < MAKE_SEMANTIC_VERSION(30, 1, 0)
-#include <util/circlebuf.h>
-#define deque circlebuf
-#define deque_pop_front circlebuf_pop_front
-#define deque_push_back circlebuf_push_back
-#define deque_free circlebuf_free
-#else
-#include <util/deque.h>
-#endif
 #include "socket.h"
+#include "audio-ring.h"
+#include "vban-encode.h"
+#include "vban-send.h"
+
+/* Number of slots in the ring between the audio thread and the transmit scheduler.
+ * Each slot holds one audio tick of OBS Studio. */
+#define VBAN_OUT_RING_SLOTS 32
+
+/* Maximum number of destinations of one output */
+#define VBAN_OUT_DEST_MAX 16
+
+/* How the audio is carried in the packets */
+enum vban_out_codec
+{
+	VBAN_OUT_CODEC_PCM = 0,
+	VBAN_OUT_CODEC_OPUS = 1, // compressed under `VBAN_CODEC_USER`, see vban-opus.h
+};
+
+/* What to do when the audio waiting to be sent exceeds `max_queue_ms` */
+enum vban_out_queue_policy
+{
+	VBAN_OUT_QUEUE_CATCH_UP = 0,    // send the backlog without waiting for the packet interval
+	VBAN_OUT_QUEUE_DROP_OLDEST = 1, // drop the oldest audio
+};
+
+struct vban_out_dest_s
+{
+	char *host;
+	int port;
+	char *stream_name; // NULL to use the stream name of the output
+	struct in_addr addr;
+	struct resolve_cache_s *rc; // NULL if `host` is an address
+
+	// statistics
+	uint64_t cnt_packets;
+	uint64_t cnt_bytes;
+};
+
+/* Audio of one mixer track, sent as its own VBAN stream */
+struct vban_out_track_s
+{
+	size_t mixer;
+	audio_ring_t *ring;
+	struct output_thread_s *stream;
+};
 
 struct vban_out_s
 {
@@ -19,24 +55,140 @@ struct vban_out_s
 	// properties
 	int port;
 	char *stream_name;
-	struct in_addr ip_to;
-	size_t mixer;
+	DARRAY(struct vban_out_dest_s) dests;
+	uint32_t dests_gen; // incremented when `dests` is rebuilt
+	uint32_t mixers;    // bitmask of the tracks to send, applied at the start
 	int frequency;
+	int resampler_quality; // enum vban_resampler_quality
 	size_t channels;
+	struct vban_channel_map_s channel_map;
 	uint8_t format_bit;
+	bool dither;
+	int codec;              // enum vban_out_codec
+	int opus_bitrate;       // kbit/s for each channel
+	int samples_per_packet; // 0 to choose from `latency_ms`
+	int latency_ms;
+	bool pacing;
+	bool txtime;
+	bool batch;
+	bool obs_conversion;
+	int fec_group; // number of packets protected by a parity packet, 0 to disable
+	int max_queue_ms;
+	int queue_policy; // enum vban_out_queue_policy
+	bool silence_gate;
+	int silence_hold_ms;
+	bool inline_send; // filter only
+	bool aggregate;
+
+	// Audio format requested to libobs when `obs_conversion` is set at the start
+	struct
+	{
+		bool active;
+		int frequency;
+		uint8_t format_bit;
+		bool opus;
+	} conv;
 
-	// thread
 	pthread_mutex_t mutex;
-	os_event_t *event;
-	pthread_t thread;
-	volatile bool cont;
 
-	struct resolve_thread_s *rt;
+	// streams registered to the transmit scheduler, one for each track, all on the same worker
+	struct vban_out_track_s tracks[MAX_AUDIO_MIXES];
+	size_t n_tracks;
+	bool aggregated;  // the tracks are sent as one stream by the first track
+	os_event_t *wake; // event of the worker processing the streams
 
-	struct deque buffer;
+	// The audio callbacks use the tracks only while `accepting` is set, counted in `audio_users`.
+	volatile bool accepting;
+	volatile long audio_users;
 
-	uint64_t cnt_packets;
+	// statistics of the flushed packets, reflected from the streams
+	struct vban_send_stats_s tx;
 	uint64_t cnt_frames;
 };
 
-void *vban_out_thread_main(void *data);
+/**
+ * Enter the audio callback, which uses the rings and the streams of the tracks.
+ * @param[in] v  The output.
+ * @return       False if the output is not accepting audio; `vban_out_audio_leave` must not be called then.
+ *
+ * Neither memory is allocated nor a mutex is waited for.
+ */
+static inline bool vban_out_audio_enter(struct vban_out_s *v)
+{
+	os_atomic_inc_long(&v->audio_users);
+	if (os_atomic_load_bool(&v->accepting))
+		return true;
+	os_atomic_dec_long(&v->audio_users);
+	return false;
+}
+
+/**
+ * Leave the audio callback.
+ * @param[in] v  The output.
+ */
+static inline void vban_out_audio_leave(struct vban_out_s *v)
+{
+	os_atomic_dec_long(&v->audio_users);
+}
+
+/**
+ * Create the state of the stream of a track of an output or a filter.
+ * @param[in] v      The output.
+ * @param[in] track  The track, whose `ring` is already created.
+ * @param[in] send   The socket shared by the streams of the worker.
+ * @return           The stream, or NULL if the settings cannot be applied.
+ */
+struct output_thread_s *vban_out_stream_create(struct vban_out_s *v, struct vban_out_track_s *track,
+					       struct vban_send_s *send);
+
+/**
+ * Create a stream that sends all tracks of an output as one stream with the channels of the tracks side by side.
+ * @param[in] v     The output, whose rings of the tracks are already created.
+ * @param[in] send  The socket shared by the streams of the worker.
+ * @return          The stream, or NULL if the settings cannot be applied.
+ */
+struct output_thread_s *vban_out_stream_create_aggregate(struct vban_out_s *v, struct vban_send_s *send);
+
+/**
+ * Destroy the stream. The statistics are reflected to the output.
+ * @param[in] t  The stream.
+ */
+void vban_out_stream_destroy(struct output_thread_s *t);
+
+/**
+ * Encode available audio and queue the packets that are due.
+ * @param[in] t  The stream.
+ * @return       The time by `os_gettime_ns` to call again, or 0 to wait for the next audio.
+ *
+ * Queued packets refer to the buffer of the stream and have to be flushed before the next call.
+ */
+uint64_t vban_out_stream_step(struct output_thread_s *t);
+
+/**
+ * Check if the stream wants the departure time scheduled by the kernel.
+ * @param[in] t  The locked stream.
+ * @return       True if pacing by SO_TXTIME is configured, even if the socket could not enable it.
+ */
+bool vban_out_stream_wants_txtime(const struct output_thread_s *t);
+
+/**
+ * Lock the stream against the inline path while the worker steps it and flushes the packets.
+ * @param[in] t  The stream.
+ */
+void vban_out_stream_lock(struct output_thread_s *t);
+
+/**
+ * Unlock the stream.
+ * @param[in] t  The stream.
+ */
+void vban_out_stream_unlock(struct output_thread_s *t);
+
+/**
+ * Encode and send the audio in the calling thread without waiting.
+ * @param[in] t       The stream.
+ * @param[in] frames  The audio in the format of OBS Studio.
+ * @return            False if the audio has to be pushed to the ring for the worker.
+ *
+ * Called from the audio thread of the filter. Neither memory is allocated nor a mutex is waited for.
+ */
+bool vban_out_stream_inline(struct output_thread_s *t, const struct audio_data *frames);
@@ -17,328 +17,1513 @@
  */
 
 #include <obs-module.h>
-#include <media-io/audio-resampler.h>
+#include <util/platform.h>
 #include "plugin-macros.generated.h"
 #include "vban.h"
 #include "socket.h"
 #include "vban-output-internal.h"
+#include "vban-send.h"
+#include "vban-encode.h"
+#include "vban-fec.h"
+#include "vban-opus.h"
+#include "encode-cache.h"
+#include "wire-ring.h"
 #include "resolve-thread.h"
 
+struct output_dest_s
+{
+	struct sockaddr_in addr;
+	char stream_name[VBAN_STREAM_NAME_SIZE];
+
+	// statistics not yet reflected to `struct vban_out_dest_s`
+	uint64_t cnt_packets;
+	uint64_t cnt_bytes;
+};
+
+/* Settings of the encoding pipeline, which are applied at a packet boundary */
+struct pipeline_cfg
+{
+	int frequency_vban;
+	uint8_t format_bit;
+	bool dither;
+	int resampler_quality;
+	struct vban_channel_map_s map;
+	bool opus;
+	size_t opus_frame;
+	int opus_bitrate; // bit/s for each channel
+};
+
+/* State of one output or filter, stepped by a worker of the transmit scheduler */
 struct output_thread_s
 {
+	// Held by the worker during a round and tried by the inline path
+	pthread_mutex_t mutex;
+
+	char header_buf[VBAN_HEADER_SIZE];
 	struct VBanHeader *header;
-	char *payload;
+	struct audio_data pkt; // peeked from the ring, not yet encoded
+	bool failed;
 
 	struct vban_out_s *v;
+	audio_ring_t *ring; // of the track
 
+	// current configuration of the pipeline
 	int frequency_vban;
 	int frequency_src;
-	audio_resampler_t *resampler;
+	enum speaker_layout speakers;
+	size_t channels_src; // of the audio, mapped to `header->format_nbc + 1` channels
+	struct vban_channel_map_s map;
+	const void *tap;
+	size_t track;
+	bool converted; // libobs delivers interleaved samples in the format to send
+	struct vban_encoder_s encoder;
+	bool dither;
+	int resampler_quality;
+	vban_encode_resampler_t *resampler;
+	uint64_t resampler_delay_ns;
+	encode_cache_t *cache;
+	bool cache_left; // ticks are encoded by `resampler` until the next reconfiguration
+	float *prime;    // the last `CACHE_PRIME_FRAMES` frames of each plane taken from the cache
 
-	struct darray buffer;
+	// timeline of the audio timestamps
+	size_t planes;
+	size_t frame_bytes; // of each plane
+	uint8_t *silence;   // `AUDIO_OUTPUT_FRAMES` frames of zero
+	bool ts_valid;
+	uint64_t ts_base_ns;
+	uint64_t ts_frames; // frames sent since `ts_base_ns`, less than one second
+	uint64_t cnt_ts_gaps;
+	uint64_t cnt_ts_gap_frames;
+	uint64_t cnt_ts_overlaps;
+	uint64_t cnt_ts_overlap_frames;
+	uint64_t cnt_ts_restarts;
+
+	struct darray buffer; // encoded samples of one audio tick
+	uint64_t encode_ns;
+	uint64_t encode_cnt;
+	struct wire_ring_s wire;
 	uint64_t buf_ts_ns;
+	size_t nbs_max;
+	size_t data_max; // samples taken from the wire ring for one packet, in bytes
+
+	// Samples of the packed formats are held in 16 bits and packed into these payloads when sent.
+	// The slots are used in turn and outlive the packets queued to the socket.
+	char (*packed)[VBAN_DATA_MAX_SIZE]; // `VBAN_SEND_BATCH_MAX` slots, NULL unless packed
+	size_t packed_next;
+
+	// compression of each packet into an Opus frame
+	bool codec_opus;
+	size_t opus_frame; // samples in each frame
+	int opus_bitrate;
+	vban_opus_enc_t *opus;
+	uint64_t opus_ns;
+	uint64_t cnt_opus_packets;
+	uint64_t cnt_opus_bytes;
 
-	socket_t vban_socket;
+	struct vban_send_s *send; // shared with the other streams of the worker
+	bool batch;
+	struct vban_send_stats_s tx; // packets flushed since the last reflection to the output
+	uint64_t cnt_frames;         // frames sent since the last reflection to the output
+	uint64_t tx_warn_ns;         // when the packets that could not be sent were last reported
+	uint64_t tx_unreported;      // packets that could not be sent since then
+	struct vban_fec_enc_s fec;
+	uint64_t cnt_fec_parity;
+	struct output_dest_s dests[VBAN_OUT_DEST_MAX];
+	size_t n_dests;
+	uint32_t dests_gen;
+
+	// pacing
+	bool pacing;
+	bool txtime;
+	bool txtime_wanted;
+	bool pace_anchored;
+	int64_t pace_offset_ns;
+	uint64_t next_send_ns; // without pacing nor batching, the next packet is not sent before this
+	uint64_t pace_cnt;
+	uint64_t pace_err_abs_sum_ns;
+	int64_t pace_err_max_ns;
+	int64_t pace_err_min_ns;
+
+	// bound of the audio waiting for the stream
+	uint64_t queue_max_ns;
+	int queue_policy; // enum vban_out_queue_policy
+	bool queue_over;
+	bool catching_up;
+	uint64_t queue_peak_ns;
+	uint64_t cnt_queue_exceeded;
+	uint64_t cnt_queue_drop_frames;
+
+	// silence gate
+	uint64_t gate_hold_ns; // 0 if disabled
+	bool gate_quiet;
+	uint64_t gate_quiet_ns; // timestamp of the first silent tick
+	bool gated;
+	uint64_t gate_sent_ns; // timestamp of the last tick sent while the gate is closed
+	uint64_t cnt_gate_closes;
+	uint64_t cnt_gate_keepalives;
+	uint64_t cnt_gate_frames;
+
+	// sending from the audio thread of the filter
+	struct vban_send_s inline_send;
+	bool inline_ok;
+	uint64_t inline_resume_ns;
+	uint64_t cnt_inline;
+	volatile long cnt_inline_fallback; // also counted without the lock
+
+	// aggregation of several tracks into one stream
+	struct output_thread_s *parts[MAX_AUDIO_MIXES];
+	size_t n_parts;
+	bool parts_aligned;
+	bool part;             // encodes a track for the aggregation and does not send by itself
+	struct darray pending; // frames encoded by a part, not yet interleaved
 };
 
-static enum audio_format closest_format(uint8_t format_bit)
+/* If a packet is late or early more than these, the departure time is anchored again. */
+#define PACE_LATE_LIMIT_NS (100 * 1000000LL)
+#define PACE_EARLY_LIMIT_NS (500 * 1000000LL)
+
+/* With SO_TXTIME, packets are handed to the kernel this much earlier than their departure time.
+ * In batch mode, packets are gathered over the longer period so that one audio tick makes one system call. */
+#define TXTIME_LOOKAHEAD_NS (2 * 1000000LL)
+#define TXTIME_BATCH_LOOKAHEAD_NS (30 * 1000000LL)
+
+/* Audio ticks off the expected timestamp by less than this are regarded as continuous,
+ * which absorbs the jitter of the timestamps of sources. */
+#define TS_TOLERANCE_NS (1 * 1000000LL)
+/* If the timestamp jumps more than this, the timeline restarts at the tick instead of inserting silence. */
+#define TS_RESTART_NS (500 * 1000000LL)
+
+/* A tick whose samples are all below this is silent, which is less than 1 LSB of 24-bit integer. */
+#define GATE_SILENCE_PEAK (1.0f / 8388608.0f)
+/* Packets that could not be sent are reported to the log at most once in this interval. */
+#define TX_WARN_INTERVAL_NS (10 * 1000000000ULL)
+
+/* While the silence gate is closed, one tick is sent at this interval so that receivers keep the stream. */
+#define GATE_KEEPALIVE_NS (1000 * 1000000LL)
+
+/* The inline path gives up sending and leaves the rest to the worker once it took this long in the audio thread. */
+#define INLINE_BUDGET_NS (300 * 1000LL)
+/* After the inline path fell back because of the budget or a full socket buffer, it stays off for this period. */
+#define INLINE_BACKOFF_NS (1000 * 1000000LL)
+/* Packets that did not fit the socket buffer of the inline path are kept and the worker sends them again
+ * up to this many times before dropping them. */
+#define INLINE_RETRY_MAX 3
+
+/* Frames of the audio kept to prime the resampler of a stream when it stops taking the ticks from the cache.
+ * This covers the history of the built-in resampler, whose filters have up to 256 taps. */
+#define CACHE_PRIME_FRAMES 256
+
+static bool find_sr(int frequency, uint8_t *format_sr)
+{
+	for (uint8_t sr = 0; sr < VBAN_SR_MAXNUMBER; sr++) {
+		if (VBanSRList[sr] == frequency) {
+			*format_sr = sr;
+			return true;
+		}
+	}
+	return false;
+}
+
+static size_t packet_samples(const struct vban_out_s *v, int frequency)
+{
+	if (v->samples_per_packet > 0)
+		return v->samples_per_packet < 256 ? (size_t)v->samples_per_packet : 256;
+
+	// Choose the largest power of two that fits in the latency budget.
+	size_t nbs = 256;
+	while (nbs > 16 && (uint64_t)nbs * 1000 > (uint64_t)v->latency_ms * frequency)
+		nbs /= 2;
+	return nbs;
+}
+
+static void pipeline_want_unlocked(const struct vban_out_s *v, const struct output_thread_s *t,
+				   struct pipeline_cfg *want)
+{
+	if (t->converted) {
+		// The format was requested to libobs at the start and cannot be changed while running.
+		want->frequency_vban = v->conv.frequency;
+		want->format_bit = v->conv.format_bit;
+		want->dither = false;
+		want->resampler_quality = t->resampler_quality;
+		memset(&want->map, 0, sizeof(want->map));
+		want->opus = v->conv.opus;
+	}
+	else {
+		want->frequency_vban = v->frequency ? v->frequency : t->frequency_src;
+		want->format_bit = v->format_bit;
+		want->dither = v->dither;
+		want->resampler_quality = v->resampler_quality;
+		want->map = v->channel_map;
+		want->opus = v->codec == VBAN_OUT_CODEC_OPUS;
+	}
+
+	want->opus_frame = 0;
+	want->opus_bitrate = 0;
+	if (want->opus && !t->converted) {
+		// Opus takes float samples at a few rates.
+		want->format_bit = VBAN_BITFMT_32_FLOAT;
+		want->dither = false;
+		if (!vban_opus_rate_supported(want->frequency_vban))
+			want->frequency_vban = 48000;
+	}
+	if (want->opus) {
+		size_t packet = packet_samples(v, want->frequency_vban);
+		want->opus_frame = vban_opus_frame_samples(want->frequency_vban, packet);
+		want->opus_bitrate = v->opus_bitrate * 1000;
+	}
+}
+
+static bool pipeline_changed(const struct output_thread_s *t, const struct pipeline_cfg *want)
+{
+	return want->frequency_vban != t->frequency_vban || want->format_bit != t->header->format_bit ||
+	       want->dither != t->dither || want->resampler_quality != t->resampler_quality ||
+	       memcmp(&want->map, &t->map, sizeof(want->map)) != 0 || want->opus != t->codec_opus ||
+	       want->opus_frame != t->opus_frame || want->opus_bitrate != t->opus_bitrate;
+}
+
+static void warn_absent_channels(const struct vban_channel_map_s *map, size_t channels_src)
 {
-	switch (format_bit) {
-	case VBAN_BITFMT_16_INT:
-		return AUDIO_FORMAT_16BIT;
-	case VBAN_BITFMT_24_INT:
-		return AUDIO_FORMAT_32BIT;
-	case VBAN_BITFMT_32_INT:
-		return AUDIO_FORMAT_32BIT;
-	case VBAN_BITFMT_32_FLOAT:
-		return AUDIO_FORMAT_FLOAT;
-	default:
-		blog(LOG_ERROR, "Unimplemented format %d is requested", (int)format_bit);
-		return AUDIO_FORMAT_UNKNOWN;
+	for (size_t src = channels_src; src < MAX_AV_PLANES; src++) {
+		for (size_t ch = 0; ch < map->channels; ch++) {
+			if (map->gain[ch][src] != 0.0f) {
+				blog(LOG_WARNING,
+				     "vban-out: channel map refers to channel %d, which the audio does not have",
+				     (int)src + 1);
+				break;
+			}
+		}
 	}
 }
 
-static bool thread_loop_start(struct output_thread_s *t)
+/* Returns the bytes in the wire ring whose samples fit in a payload of `payload_max` bytes. */
+static size_t wire_bytes_for(uint8_t format_bit, size_t payload_max)
+{
+	unsigned bits = vban_packed_bits(format_bit);
+	if (bits)
+		return payload_max * 8 / bits * vban_encode_sample_size(format_bit);
+	return payload_max;
+}
+
+/* Creates the Opus encoder for the channels and the rate of the pipeline, or the payloads of a packed format.
+ * Parts of an aggregation do not send by themselves and have neither. */
+static bool codec_apply(struct output_thread_s *t)
+{
+	vban_opus_enc_destroy(t->opus);
+	t->opus = NULL;
+	bfree(t->packed);
+	t->packed = NULL;
+
+	size_t channels = (size_t)t->header->format_nbc + 1;
+	t->data_max = wire_bytes_for(t->header->format_bit, VBAN_DATA_MAX_SIZE);
+	if (vban_packed_bits(t->header->format_bit) && !t->codec_opus && !t->part) {
+		t->packed = bmalloc(VBAN_SEND_BATCH_MAX * sizeof(*t->packed));
+		t->packed_next = 0;
+	}
+	if (!t->codec_opus || t->part)
+		return true;
+
+	t->opus = vban_opus_enc_create(t->frequency_vban, channels, t->opus_frame, t->opus_bitrate);
+	if (!t->opus) {
+		blog(LOG_ERROR, "vban-out: cannot encode %d channels at %d Hz by Opus", (int)channels,
+		     t->frequency_vban);
+		return false;
+	}
+	blog(LOG_INFO, "vban-out: Opus frames of %zu samples, %.1f ms, %d kbit/s", t->opus_frame,
+	     (double)t->opus_frame * 1e3 / t->frequency_vban, t->opus_bitrate * (int)channels / 1000);
+
+	// A packet carries one frame, whose samples are taken from the wire ring before compression.
+	t->nbs_max = t->opus_frame;
+	t->data_max = t->opus_frame * channels * sizeof(float);
+	return true;
+}
+
+/* Rebuilds the stages affected by the difference from the current configuration.
+ * The socket, the destinations and the frame counter are kept. */
+static bool pipeline_apply(struct output_thread_s *t, const struct pipeline_cfg *want)
+{
+	struct VBanHeader *header = t->header;
+
+	uint8_t format_sr;
+	if (!find_sr(want->frequency_vban, &format_sr)) {
+		blog(LOG_ERROR, "VBAN cannot handle sampling frequency %d Hz", want->frequency_vban);
+		return false;
+	}
+
+	size_t channels = vban_channel_map_count(&want->map, t->channels_src);
+	warn_absent_channels(&want->map, t->channels_src);
+
+	blog(LOG_INFO, "vban-out configuring format_bit=%d channels=%d frequency=%u", (int)want->format_bit,
+	     (int)channels, want->frequency_vban);
+
+	// The sent channels are mapped before resampling so that the resampler has as many channels.
+	if (want->frequency_vban != t->frequency_vban || want->resampler_quality != t->resampler_quality ||
+	    channels != (size_t)header->format_nbc + 1) {
+		vban_encode_destroy_resampler(t->resampler);
+		t->resampler = NULL;
+		t->resampler_delay_ns = 0;
+		if (want->frequency_vban != t->frequency_src) {
+			t->resampler = vban_encode_create_resampler(t->frequency_src, t->speakers, channels,
+								    want->frequency_vban, want->resampler_quality);
+			t->resampler_delay_ns = t->resampler ? vban_encode_resampler_delay_ns(t->resampler) : 0;
+		}
+	}
+
+	vban_encoder_init(&t->encoder, want->format_bit, &want->map, t->channels_src, want->dither);
+	header->format_nbc = (uint8_t)(channels - 1);
+
+	/* Outputs connected to the same track share the encoded samples.
+	 * Filters are not shared since each filter sees the audio of its own source. */
+	if (t->cache)
+		encode_cache_release(t->cache);
+	t->cache = NULL;
+	t->cache_left = false;
+	if (t->prime)
+		memset(t->prime, 0, t->planes * CACHE_PRIME_FRAMES * sizeof(float));
+	if (t->tap) {
+		const struct encode_cache_key key = {
+			.tap = t->tap,
+			.track = t->track,
+			.rate_src = t->frequency_src,
+			.speakers = t->speakers,
+			.channels = t->channels_src,
+			.map = want->map,
+			.rate_vban = want->frequency_vban,
+			.format_bit = want->format_bit,
+			.dither = want->dither,
+			.resampler_quality = want->resampler_quality,
+		};
+		t->cache = encode_cache_find_or_create(&key);
+	}
+
+	/* Reserved for the largest audio tick so that encoding does not allocate memory,
+	 * which is required in the audio thread. */
+	size_t frames_max = (size_t)AUDIO_OUTPUT_FRAMES * want->frequency_vban / t->frequency_src + 64;
+	darray_reserve(1, &t->buffer, frames_max * ((size_t)header->format_nbc + 1) * sizeof(int32_t));
+
+	header->format_SR = format_sr;
+	header->format_bit = want->format_bit;
+	t->frequency_vban = want->frequency_vban;
+	t->dither = want->dither;
+	t->resampler_quality = want->resampler_quality;
+	t->map = want->map;
+	t->codec_opus = want->opus;
+	t->opus_frame = want->opus_frame;
+	t->opus_bitrate = want->opus_bitrate;
+	t->pace_anchored = false;
+
+	return codec_apply(t);
+}
+
+static void pipeline_release(struct output_thread_s *t)
+{
+	vban_opus_enc_destroy(t->opus);
+	t->opus = NULL;
+	bfree(t->packed);
+	t->packed = NULL;
+	vban_encode_destroy_resampler(t->resampler);
+	t->resampler = NULL;
+	if (t->cache)
+		encode_cache_release(t->cache);
+	t->cache = NULL;
+}
+
+static bool stream_start(struct output_thread_s *t)
 {
 	struct vban_out_s *v = t->v;
 	struct VBanHeader *header = t->header;
+	struct pipeline_cfg want;
 
 	pthread_mutex_lock(&v->mutex);
 	const obs_output_t *output = t->v->context;
 
 	const struct audio_output_info *aoi;
-	if (output)
+	if (output) {
 		aoi = audio_output_get_info(obs_output_audio(output));
+		t->tap = obs_output_audio(output);
+	}
 	else
 		aoi = audio_output_get_info(obs_get_audio());
 
 	t->frequency_src = aoi->samples_per_sec;
+	t->speakers = aoi->speakers;
+	t->channels_src = v->channels;
+	t->planes = v->channels;
+	t->part = v->aggregated;
+	t->frame_bytes = sizeof(float);
 
-	if (v->frequency)
-		t->frequency_vban = v->frequency;
-	else
-		t->frequency_vban = t->frequency_src;
+	// libobs delivers the samples already resampled and converted; they are not shared either.
+	t->converted = v->conv.active;
+	if (t->converted) {
+		t->frequency_src = v->conv.frequency;
+		t->tap = NULL;
+		t->planes = 1;
+		t->frame_bytes =
+			v->channels * get_audio_bytes_per_channel(vban_encode_interleaved_format(v->conv.format_bit));
+	}
+	t->silence = bzalloc(AUDIO_OUTPUT_FRAMES * t->frame_bytes);
+	if (t->converted && v->conv.format_bit == VBAN_BITFMT_8_INT)
+		memset(t->silence, 0x80, AUDIO_OUTPUT_FRAMES * t->frame_bytes);
+	if (!t->converted)
+		t->prime = bzalloc(t->planes * CACHE_PRIME_FRAMES * sizeof(float));
 
-	header->format_bit = v->format_bit;
-	header->format_nbc = (uint8_t)(v->channels - 1);
+	pipeline_want_unlocked(v, t, &want);
 
 	pthread_mutex_unlock(&v->mutex);
 
 	memcpy(&header->vban, "VBAN", 4);
+	header->nuFrame = 0;
 
-	bool sr_found = false;
-	for (uint8_t sr = 0; sr < VBAN_SR_MAXNUMBER; sr++) {
-		if (VBanSRList[sr] == t->frequency_vban) {
-			header->format_SR = sr;
-			sr_found = true;
-			break;
+	return pipeline_apply(t, &want);
+}
+
+/* With several tracks, each track is sent as a stream whose name has the track number appended. */
+static void track_stream_name(char *dst, const char *name, const struct vban_out_s *v, const struct output_thread_s *t)
+{
+	size_t len = strnlen(name, VBAN_STREAM_NAME_SIZE);
+	memset(dst, 0, VBAN_STREAM_NAME_SIZE);
+	if (v->n_tracks <= 1 || t->n_parts) {
+		memcpy(dst, name, len);
+		return;
+	}
+
+	// The suffix "-N" overwrites the end of a long name so that the tracks stay distinguishable.
+	char suffix[8];
+	size_t suffix_len = 0;
+	char digits[4];
+	size_t n_digits = 0;
+	for (size_t n = t->track + 1; n && n_digits < sizeof(digits); n /= 10)
+		digits[n_digits++] = (char)('0' + n % 10);
+	suffix[suffix_len++] = '-';
+	while (n_digits)
+		suffix[suffix_len++] = digits[--n_digits];
+
+	if (len > VBAN_STREAM_NAME_SIZE - suffix_len)
+		len = VBAN_STREAM_NAME_SIZE - suffix_len;
+	memcpy(dst, name, len);
+	memcpy(dst + len, suffix, suffix_len);
+}
+
+static void sync_dests_unlocked(struct vban_out_s *v, struct output_thread_s *t)
+{
+	if (t->dests_gen == v->dests_gen) {
+		for (size_t i = 0; i < t->n_dests && i < v->dests.num; i++) {
+			v->dests.array[i].cnt_packets += t->dests[i].cnt_packets;
+			v->dests.array[i].cnt_bytes += t->dests[i].cnt_bytes;
 		}
 	}
-	if (!sr_found) {
-		blog(LOG_ERROR, "VBAN cannot handle sampling frequency %d Hz", t->frequency_vban);
-		return false;
+
+	t->n_dests = 0;
+	for (size_t i = 0; i < v->dests.num && i < VBAN_OUT_DEST_MAX; i++) {
+		struct vban_out_dest_s *d = v->dests.array + i;
+		struct output_dest_s *td = t->dests + t->n_dests++;
+
+		// A changed address of the host name takes effect from the next packet.
+		if (d->rc)
+			resolve_cache_get_addr(d->rc, &d->addr);
+
+		td->addr.sin_family = AF_INET;
+		td->addr.sin_port = htons(d->port);
+		td->addr.sin_addr.s_addr = d->addr.s_addr;
+		track_stream_name(td->stream_name, d->stream_name ? d->stream_name : v->stream_name, v, t);
+		td->cnt_packets = 0;
+		td->cnt_bytes = 0;
 	}
+	t->dests_gen = v->dests_gen;
+}
 
-	blog(LOG_INFO, "vban-out starting format_bit=%d channels=%d frequency=%u", (int)v->format_bit, (int)v->channels,
-	     t->frequency_vban);
+/* Reflects the results of the flushed packets to the output so that they can be read while sending.
+ * Packets that could not be sent are also reported to the log. */
+static void sync_stats_unlocked(struct vban_out_s *v, struct output_thread_s *t)
+{
+	vban_send_stats_add(&v->tx, &t->tx);
+	v->cnt_frames += t->cnt_frames;
 
-	if (t->frequency_vban != t->frequency_src) {
-		const struct resample_info src = {
-			.samples_per_sec = aoi->samples_per_sec,
-			.format = AUDIO_FORMAT_FLOAT_PLANAR,
-			.speakers = aoi->speakers,
-		};
+	t->tx_unreported += vban_send_stats_dropped(&t->tx);
+	uint64_t now = os_gettime_ns();
+	if (t->tx_unreported && now - t->tx_warn_ns >= TX_WARN_INTERVAL_NS) {
+		blog(LOG_WARNING, "vban-out: %" PRIu64 " packets could not be sent, the last one by %s (error %d)",
+		     t->tx_unreported, vban_send_error_name(v->tx.last_error), v->tx.last_errno);
+		t->tx_unreported = 0;
+		t->tx_warn_ns = now;
+	}
 
-		const struct resample_info dst = {
-			.samples_per_sec = t->frequency_vban,
-			.format = closest_format(v->format_bit),
-			.speakers = aoi->speakers,
-		};
+	memset(&t->tx, 0, sizeof(t->tx));
+	t->cnt_frames = 0;
+}
 
-		blog(LOG_INFO, "configuring resampler frequency %u -> %u", aoi->samples_per_sec, t->frequency_vban);
+/* Returns true if the pipeline has to be reconfigured to `want`. */
+static bool bring_settings_unlocked(struct vban_out_s *v, struct output_thread_s *t, struct pipeline_cfg *want)
+{
+	sync_dests_unlocked(v, t);
+	sync_stats_unlocked(v, t);
+
+	pipeline_want_unlocked(v, t, want);
+	bool reconfigure = pipeline_changed(t, want);
+
+	// The parity is not applied to Opus frames, whose length varies and whose losses the decoder conceals.
+	size_t fec_group = want->opus ? 0 : (size_t)v->fec_group;
+	if (fec_group != t->fec.group)
+		vban_fec_enc_reset(&t->fec, fec_group);
 
-		t->resampler = audio_resampler_create(&dst, &src);
+	// At high channel counts, a packet holds fewer samples than requested.
+	// The parity packet needs room for its own header in addition to the longest payload.
+	size_t payload_max = t->fec.group ? VBAN_DATA_MAX_SIZE - VBAN_FEC_HEADER_SIZE : VBAN_DATA_MAX_SIZE;
+	size_t data_max = wire_bytes_for(t->header->format_bit, payload_max);
+	size_t nbs_max = packet_samples(v, t->frequency_vban);
+	size_t sample_size = ((size_t)t->header->format_nbc + 1) * vban_encode_sample_size(t->header->format_bit);
+	if (t->codec_opus)
+		nbs_max = t->opus_frame;
+	else if (nbs_max * sample_size > data_max)
+		nbs_max = data_max / sample_size;
+	if (nbs_max != t->nbs_max) {
+		blog(LOG_INFO, "vban-out: %zu samples per packet, %.2f ms, %.0f packets/s", nbs_max,
+		     (double)nbs_max * 1e3 / t->frequency_vban, (double)t->frequency_vban / nbs_max);
+		t->nbs_max = nbs_max;
 	}
 
-	header->nuFrame = 0;
+	if (t->pacing != v->pacing) {
+		t->pacing = v->pacing;
+		t->pace_anchored = false;
+	}
 
-	t->vban_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	/* SO_TXTIME is an option of the shared socket. Packets of the other streams carry no departure time
+	 * and leave immediately, so that it is enabled once any stream wants it. */
+	bool txtime = v->pacing && v->txtime;
+	if (txtime && !t->send->txtime)
+		vban_send_set_txtime(t->send, true);
+	t->txtime = txtime && t->send->txtime;
+	t->txtime_wanted = txtime;
 
+	t->queue_max_ns = (uint64_t)v->max_queue_ms * 1000000;
+	t->queue_policy = v->queue_policy;
+
+	// The silence gate looks at planar float samples.
+	t->gate_hold_ns = v->silence_gate && !t->converted ? (uint64_t)v->silence_hold_ms * 1000000 : 0;
+
+	// Sending all ready packets at once does not help if each packet waits for its departure time in userspace.
+	t->batch = v->batch && (!t->pacing || t->txtime);
+
+	// The inline path has its own socket since the shared one is used by the worker without the lock of the stream.
+	bool inline_send = v->inline_send && !t->pacing;
+	if (inline_send && !valid_socket(t->inline_send.sock)) {
+		if (vban_send_open(&t->inline_send)) {
+			vban_send_set_batch(&t->inline_send, true);
+			vban_send_set_nonblock(&t->inline_send, true);
+			vban_send_set_retry(&t->inline_send, INLINE_RETRY_MAX, 0);
+			vban_send_set_keep(&t->inline_send, true);
+		}
+	}
+	else if (!inline_send && valid_socket(t->inline_send.sock)) {
+		vban_send_set_keep(&t->inline_send, false);
+		vban_send_flush(&t->inline_send);
+		vban_send_close(&t->inline_send);
+	}
+	t->inline_ok = inline_send && t->inline_send.nonblock;
+
+	return reconfigure;
+}
+
+/* Returns the departure time of the packet whose last sample has the timestamp `ts_end_ns`.
+ * The offset between the audio timestamp and the system time is taken at the first packet so
+ * that packets leave evenly spaced at the rate of the audio clock. */
+static uint64_t pace_target_ns(struct output_thread_s *t, uint64_t ts_end_ns)
+{
+	int64_t now = (int64_t)os_gettime_ns();
+
+	if (t->pace_anchored) {
+		int64_t target = (int64_t)ts_end_ns + t->pace_offset_ns;
+		if (now - target <= PACE_LATE_LIMIT_NS && target - now <= PACE_EARLY_LIMIT_NS)
+			return (uint64_t)target;
+		blog(LOG_DEBUG, "vban-out: re-anchoring pacing, error %" PRId64 " us", (now - target) / 1000);
+	}
+
+	t->pace_offset_ns = now - (int64_t)ts_end_ns;
+	t->pace_anchored = true;
+	return (uint64_t)now;
+}
+
+static void pace_record(struct output_thread_s *t, uint64_t target_ns)
+{
+	int64_t err = (int64_t)(os_gettime_ns() - target_ns);
+
+	if (!t->pace_cnt || err > t->pace_err_max_ns)
+		t->pace_err_max_ns = err;
+	if (!t->pace_cnt || err < t->pace_err_min_ns)
+		t->pace_err_min_ns = err;
+	t->pace_err_abs_sum_ns += (uint64_t)(err > 0 ? err : -err);
+	t->pace_cnt++;
+}
+
+/* Keeps the last frames of a tick taken from the cache. */
+static void cache_prime_keep(struct output_thread_s *t, const struct audio_data *pkt)
+{
+	size_t n = pkt->frames < CACHE_PRIME_FRAMES ? pkt->frames : CACHE_PRIME_FRAMES;
+	for (size_t i = 0; i < t->planes; i++) {
+		float *p = t->prime + i * CACHE_PRIME_FRAMES;
+		memmove(p, p + n, (CACHE_PRIME_FRAMES - n) * sizeof(float));
+		memcpy(p + CACHE_PRIME_FRAMES - n, (const float *)pkt->data[i] + pkt->frames - n, n * sizeof(float));
+	}
+}
+
+/* Stops taking the ticks from the cache, whose resampler has seen another history than the own one.
+ * The own resampler is fed the frames last taken from the cache and its output is discarded, so that it
+ * continues from the same audio without a click. */
+static void cache_leave(struct output_thread_s *t, struct darray *dst)
+{
+	struct audio_data prime = {.frames = CACHE_PRIME_FRAMES};
+	for (size_t i = 0; i < t->planes; i++)
+		prime.data[i] = (uint8_t *)(t->prime + i * CACHE_PRIME_FRAMES);
+
+	size_t num = dst->num;
+	vban_encode_resample(&t->encoder, t->resampler, &prime, dst);
+	dst->num = num;
+
+	t->cache_left = true;
+}
+
+/* Encodes the audio tick and appends it to the wire buffer.
+ * If `shared` is false, the tick is not from libobs as is and bypasses the cache.
+ * Once a tick bypasses the cache, the following ticks are resampled by the stream too,
+ * since switching between two resamplers breaks the continuity of the filter history. */
+static void encode_packet(struct output_thread_s *t, const struct audio_data *pkt, bool shared)
+{
+	uint64_t start_ns = os_gettime_ns();
+
+	// A part appends to the frames waiting for the other tracks.
+	struct darray *dst = t->part ? &t->pending : &t->buffer;
+	if (!t->part)
+		t->buffer.num = 0;
+
+	if (t->converted)
+		vban_encode_interleaved(t->header->format_bit, (size_t)t->header->format_nbc + 1, pkt, dst);
+	else if (shared && t->cache && !t->cache_left && encode_cache_get(t->cache, pkt, dst)) {
+		if (t->resampler)
+			cache_prime_keep(t, pkt);
+	}
+	else if (t->resampler) {
+		if (t->cache && !t->cache_left)
+			cache_leave(t, dst);
+		vban_encode_resample(&t->encoder, t->resampler, pkt, dst);
+	}
+	else
+		vban_encode_convert(&t->encoder, pkt, dst);
+
+	if (!t->part)
+		wire_ring_write(&t->wire, t->buffer.array, t->buffer.num);
+
+	t->encode_ns += os_gettime_ns() - start_ns;
+	t->encode_cnt++;
+}
+
+/* Writes encoded silence to the wire ring. 8-bit samples are unsigned, whose silence is not zero. */
+static void wire_write_silence(struct output_thread_s *t, size_t n)
+{
+	uint8_t buf[256];
+	memset(buf, t->header->format_bit == VBAN_BITFMT_8_INT && !t->codec_opus ? 0x80 : 0, sizeof(buf));
+	while (n) {
+		size_t l = n < sizeof(buf) ? n : sizeof(buf);
+		wire_ring_write(&t->wire, buf, l);
+		n -= l;
+	}
+}
+
+/* Returns true if the tick is not sent since the audio has been silent for the hold time.
+ * The frame counter does not advance for the suppressed ticks so that receivers do not count lost packets. */
+static bool gate_suppress(struct output_thread_s *t, const struct audio_data *pkt, size_t sample_size)
+{
+	if (!t->gate_hold_ns ||
+	    vban_encode_peak((const float *const *)pkt->data, t->planes, pkt->frames) >= GATE_SILENCE_PEAK) {
+		t->gate_quiet = false;
+		t->gated = false;
+		return false;
+	}
+
+	if (!t->gate_quiet) {
+		t->gate_quiet = true;
+		t->gate_quiet_ns = pkt->timestamp;
+	}
+	if (pkt->timestamp - t->gate_quiet_ns < t->gate_hold_ns)
+		return false;
+
+	if (!t->gated) {
+		t->gated = true;
+		t->gate_sent_ns = pkt->timestamp;
+		t->cnt_gate_closes++;
+	}
+	else if (pkt->timestamp - t->gate_sent_ns >= GATE_KEEPALIVE_NS) {
+		t->gate_sent_ns = pkt->timestamp;
+		t->cnt_gate_keepalives++;
+		return false;
+	}
+
+	// Samples short of a packet are completed with silence so that they do not wait for the audio to resume.
+	size_t rest = (t->wire.len / sample_size) % t->nbs_max;
+	if (rest)
+		wire_write_silence(t, (t->nbs_max - rest) * sample_size);
+
+	t->cnt_gate_frames += pkt->frames;
 	return true;
 }
 
-static bool bring_settings_unlocked(struct vban_out_s *v, struct output_thread_s *t, struct sockaddr_in *addr)
+static inline uint64_t ts_expected_ns(const struct output_thread_s *t)
 {
-	bool restart = false;
+	return t->ts_base_ns + t->ts_frames * 1000000000 / (uint64_t)t->frequency_src;
+}
 
-	if (v->rt && resolve_thread_done(v->rt)) {
-		resolve_thread_get_addr(v->rt, &v->ip_to);
-		resolve_thread_release(v->rt);
-		v->rt = NULL;
+static void ts_advance(struct output_thread_s *t, uint64_t frames)
+{
+	t->ts_frames += frames;
+	while (t->ts_frames >= (uint64_t)t->frequency_src) {
+		t->ts_frames -= (uint64_t)t->frequency_src;
+		t->ts_base_ns += 1000000000;
 	}
+}
 
-	addr->sin_port = htons(v->port);
-	addr->sin_addr.s_addr = v->ip_to.s_addr;
+/* Returns true if the tick starts where the previous tick ended. */
+static bool ts_continuous(const struct output_thread_s *t, const struct audio_data *pkt)
+{
+	if (!t->ts_valid)
+		return false;
+	int64_t diff = (int64_t)(pkt->timestamp - ts_expected_ns(t));
+	return -TS_TOLERANCE_NS < diff && diff < TS_TOLERANCE_NS;
+}
 
-	if (v->frequency && v->frequency != t->frequency_vban) {
-		blog(LOG_INFO, "restarting to change frequency from %d to %d", (int)t->frequency_vban,
-		     (int)v->frequency);
-		restart = true;
+static void encode_silence(struct output_thread_s *t, uint64_t frames)
+{
+	struct audio_data pkt = {0};
+	for (size_t i = 0; i < t->planes; i++)
+		pkt.data[i] = t->silence;
+
+	while (frames) {
+		pkt.frames = frames < AUDIO_OUTPUT_FRAMES ? (uint32_t)frames : AUDIO_OUTPUT_FRAMES;
+		encode_packet(t, &pkt, false);
+		ts_advance(t, pkt.frames);
+		frames -= pkt.frames;
 	}
+}
+
+/* Keeps the sent samples on the timeline of the audio timestamps so that the stream does not shift
+ * when libobs or the ring drops or repeats audio ticks. Silence is encoded for a gap, and the frames
+ * already sent are trimmed from an overlapping tick.
+ * Returns false if the whole tick has been sent already. `*trimmed` is set if the tick was modified. */
+static bool ts_align(struct output_thread_s *t, struct audio_data *pkt, bool *trimmed)
+{
+	*trimmed = false;
 
-	if (v->format_bit != t->header->format_bit) {
-		blog(LOG_INFO, "restarting to change format_bit from %d to %d", t->header->format_bit, v->format_bit);
-		restart = true;
+	if (t->ts_valid && !ts_continuous(t, pkt)) {
+		int64_t diff = (int64_t)(pkt->timestamp - ts_expected_ns(t));
+		uint64_t diff_abs = (uint64_t)(diff > 0 ? diff : -diff);
+		uint64_t frames = diff_abs * (uint64_t)t->frequency_src / 1000000000;
+
+		if (diff_abs >= TS_RESTART_NS) {
+			blog(LOG_WARNING, "vban-out: audio timestamp jumped by %" PRId64 " ms, restarting the timeline",
+			     diff / 1000000);
+			t->cnt_ts_restarts++;
+			t->ts_valid = false;
+		}
+		else if (diff > 0) {
+			t->cnt_ts_gaps++;
+			t->cnt_ts_gap_frames += frames;
+			encode_silence(t, frames);
+		}
+		else if (frames >= pkt->frames) {
+			t->cnt_ts_overlaps++;
+			t->cnt_ts_overlap_frames += pkt->frames;
+			return false;
+		}
+		else {
+			t->cnt_ts_overlaps++;
+			t->cnt_ts_overlap_frames += frames;
+			for (size_t i = 0; i < t->planes; i++)
+				pkt->data[i] += frames * t->frame_bytes;
+			pkt->frames -= (uint32_t)frames;
+			pkt->timestamp += frames * 1000000000 / (uint64_t)t->frequency_src;
+			*trimmed = true;
+		}
+	}
+
+	if (!t->ts_valid) {
+		t->ts_base_ns = pkt->timestamp;
+		t->ts_frames = 0;
+		t->ts_valid = true;
 	}
 
-	strncpy(t->header->streamname, v->stream_name, VBAN_STREAM_NAME_SIZE);
+	return true;
+}
+
+static size_t ready_packet_samples(const struct output_thread_s *t, size_t sample_size)
+{
+	size_t nbs = t->wire.len / sample_size;
+	if (nbs < t->nbs_max && t->wire.len + sample_size <= t->data_max)
+		return 0;
 
-	return restart;
+	if (nbs * sample_size > t->data_max)
+		nbs = t->data_max / sample_size;
+	if (nbs > t->nbs_max)
+		nbs = t->nbs_max;
+	return nbs;
 }
 
-static void resample_from_packet(struct output_thread_s *t, const struct audio_data *pkt)
+/* Sends the parity packet of the packets sent since the previous parity packet. */
+static void send_parity(struct output_thread_s *t, struct vban_send_s *send, uint64_t txtime_ns)
 {
-	uint8_t *data[MAX_AV_PLANES] = {0};
-	uint32_t out_samples = 0;
-	uint64_t ts_offset = 0;
-	if (!audio_resampler_resample(t->resampler, data, &out_samples, &ts_offset, (const uint8_t *const *)pkt->data,
-				      pkt->frames)) {
-		blog(LOG_ERROR, "Failed to resample");
+	char header_buf[VBAN_HEADER_SIZE];
+	struct VBanHeader *header = (struct VBanHeader *)header_buf;
+	memcpy(header, t->header, VBAN_HEADER_SIZE);
+
+	const char *payload[2] = {NULL, NULL};
+	size_t payload_len[2] = {0, 0};
+	payload_len[0] = vban_fec_enc_finish(&t->fec, header, &payload[0]);
+	if (!payload_len[0])
 		return;
+
+	for (size_t i = 0; i < t->n_dests; i++) {
+		struct output_dest_s *d = t->dests + i;
+		memcpy(header->streamname, d->stream_name, VBAN_STREAM_NAME_SIZE);
+		vban_send_commit(send, header, payload, payload_len, &d->addr, txtime_ns, &t->tx);
+		d->cnt_packets++;
+		d->cnt_bytes += VBAN_HEADER_SIZE + payload_len[0];
 	}
 
-	size_t channels = t->v->channels;
-	size_t fmt_size = VBanBitResolutionSize[t->header->format_bit & VBAN_BIT_RESOLUTION_MASK];
-	size_t sample_size = channels * fmt_size;
+	// The parity is accumulated in place by the next packet.
+	vban_send_flush(send);
+	t->cnt_fec_parity++;
+}
 
-	size_t offset = t->buffer.num;
-	darray_resize(1, &t->buffer, offset + out_samples * sample_size);
-	char *dst = (char *)t->buffer.array + offset;
-	char *src = (char *)data[0];
-
-	switch (t->header->format_bit) {
-	case VBAN_BITFMT_24_INT:
-		for (uint32_t i = 0; i < channels * out_samples; i++) {
-			src++;
-			*dst++ = *src++;
-			*dst++ = *src++;
-			*dst++ = *src++;
-		}
-		break;
-	case VBAN_BITFMT_16_INT:
-	case VBAN_BITFMT_32_INT:
-	case VBAN_BITFMT_32_FLOAT:
-		memcpy(dst, src, out_samples * sample_size);
-		break;
-	default:
-		blog(LOG_ERROR, "Unimplemented format %d", (int)t->header->format_bit);
+/* Compresses the samples of a packet into an Opus frame, padded with silence if the packet is short. */
+static void send_opus(struct output_thread_s *t, struct vban_send_s *send, const char *const pcm[2],
+		      const size_t pcm_len[2], uint64_t txtime_ns)
+{
+	char header_buf[VBAN_HEADER_SIZE];
+	struct VBanHeader *header = (struct VBanHeader *)header_buf;
+	memcpy(header, t->header, VBAN_HEADER_SIZE);
+	header->format_bit = (header->format_bit & ~VBAN_CODEC_MASK) | VBAN_CODEC_USER;
+	header->format_nbs = (uint8_t)(t->opus_frame - 1);
+
+	uint64_t start_ns = os_gettime_ns();
+	const char *payload[2] = {NULL, NULL};
+	size_t payload_len[2] = {0, 0};
+	payload_len[0] = vban_opus_enc_encode(t->opus, pcm, pcm_len, &payload[0]);
+	t->opus_ns += os_gettime_ns() - start_ns;
+	if (!payload_len[0])
+		return;
+
+	for (size_t i = 0; i < t->n_dests; i++) {
+		struct output_dest_s *d = t->dests + i;
+		memcpy(header->streamname, d->stream_name, VBAN_STREAM_NAME_SIZE);
+		vban_send_commit(send, header, payload, payload_len, &d->addr, txtime_ns, &t->tx);
+		d->cnt_packets++;
+		d->cnt_bytes += VBAN_HEADER_SIZE + payload_len[0];
 	}
+
+	// The payload is overwritten by the next frame.
+	vban_send_flush(send);
+	t->cnt_opus_packets++;
+	t->cnt_opus_bytes += payload_len[0];
 }
 
-static void convert_from_packet(struct output_thread_s *t, struct audio_data *pkt)
+static void send_packet(struct output_thread_s *t, struct vban_send_s *send, size_t nbs, size_t sample_size,
+			uint64_t txtime_ns)
 {
-	size_t channels = t->v->channels;
-	size_t fmt_size = VBanBitResolutionSize[t->header->format_bit & VBAN_BIT_RESOLUTION_MASK];
-	size_t sample_size = channels * fmt_size;
+	t->header->format_nbs = (uint8_t)(nbs - 1);
+	size_t n = nbs * sample_size;
+	t->cnt_frames += nbs;
 
-	size_t offset = t->buffer.num;
-	darray_resize(1, &t->buffer, offset + pkt->frames * sample_size);
+	/* The payload is sent from the ring in place and shared by all destinations.
+	 * Only the stream name in the header differs. */
+	const char *payload[2];
+	size_t payload_len[2];
+	wire_ring_peek(&t->wire, n, payload, payload_len);
 
-	char *dst = (char *)t->buffer.array + offset;
+	if (t->opus) {
+		send_opus(t, send, payload, payload_len, txtime_ns);
+		wire_ring_consume(&t->wire, n);
+		return;
+	}
 
-	switch (t->header->format_bit) {
-	case VBAN_BITFMT_16_INT:
-		for (uint32_t i = 0; i < pkt->frames; i++) {
-			for (size_t ch = 0; ch < channels; ch++) {
-				int16_t v = (int16_t)(((float *)pkt->data[ch])[i] * (1 << 15));
-				*dst++ = v & 0xFF;
-				*dst++ = v >> 8;
-			}
+	if (t->packed) {
+		char *dst = t->packed[t->packed_next];
+		t->packed_next = (t->packed_next + 1) % VBAN_SEND_BATCH_MAX;
+		payload_len[0] = vban_encode_pack(t->header->format_bit, (uint8_t *)dst, payload, payload_len);
+		payload_len[1] = 0;
+		payload[0] = dst;
+	}
+
+	for (size_t i = 0; i < t->n_dests; i++) {
+		struct output_dest_s *d = t->dests + i;
+		memcpy(t->header->streamname, d->stream_name, VBAN_STREAM_NAME_SIZE);
+		vban_send_commit(send, t->header, payload, payload_len, &d->addr, txtime_ns, &t->tx);
+		d->cnt_packets++;
+		d->cnt_bytes += VBAN_HEADER_SIZE + payload_len[0] + payload_len[1];
+	}
+
+	if (vban_fec_enc_add(&t->fec, t->header, payload, payload_len))
+		send_parity(t, send, txtime_ns);
+
+	wire_ring_consume(&t->wire, n);
+}
+
+/* Sends all encoded samples, the last packet possibly shorter than the others,
+ * so that the samples encoded next can be in a different format or rate. */
+static void drain_wire(struct output_thread_s *t, size_t sample_size)
+{
+	while (t->wire.len >= sample_size) {
+		size_t nbs = t->wire.len / sample_size;
+		if (nbs > t->nbs_max)
+			nbs = t->nbs_max;
+		if (nbs * sample_size > t->data_max)
+			nbs = t->data_max / sample_size;
+		send_packet(t, t->send, nbs, sample_size, 0);
+		t->header->nuFrame++;
+	}
+	// The group is closed since the next packets may be in another format.
+	send_parity(t, t->send, 0);
+	vban_send_flush(t->send);
+	wire_ring_consume(&t->wire, t->wire.len);
+}
+
+static inline uint64_t earliest(uint64_t a, uint64_t b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	return a < b ? a : b;
+}
+
+/* Returns the duration of the audio waiting in the ring and in the wire buffer. */
+static uint64_t queued_ns(const struct output_thread_s *t, size_t sample_size)
+{
+	uint64_t frames = 0;
+	if (t->n_parts) {
+		for (size_t k = 0; k < t->n_parts; k++) {
+			uint64_t f = audio_ring_queued_frames(t->parts[k]->ring);
+			if (f > frames)
+				frames = f;
 		}
-		break;
-	case VBAN_BITFMT_24_INT:
-		for (uint32_t i = 0; i < pkt->frames; i++) {
-			for (size_t ch = 0; ch < channels; ch++) {
-				int32_t v = (int32_t)(((float *)pkt->data[ch])[i] * (1 << 23));
-				*dst++ = v & 0xFF;
-				*dst++ = (v >> 8) & 0xFF;
-				*dst++ = v >> 16;
-			}
+	}
+	else {
+		frames = audio_ring_queued_frames(t->ring);
+	}
+
+	return frames * 1000000000 / (uint64_t)t->frequency_src +
+	       (uint64_t)(t->wire.len / sample_size) * 1000000000 / (uint64_t)t->frequency_vban;
+}
+
+/* Drops the oldest audio ticks in the ring until `frames` frames are dropped. */
+static uint64_t drop_oldest(audio_ring_t *ring, uint64_t frames)
+{
+	uint64_t dropped = 0;
+	struct audio_data pkt;
+	while (dropped < frames && audio_ring_peek(ring, &pkt)) {
+		dropped += pkt.frames;
+		audio_ring_pop(ring);
+	}
+	return dropped;
+}
+
+/* Keeps the audio waiting for the stream within the limit so that a stall does not turn into a lasting latency.
+ * Either the oldest audio is dropped and the timeline restarts, or the backlog is sent without waiting. */
+static void queue_limit(struct output_thread_s *t, size_t sample_size)
+{
+	uint64_t queued = queued_ns(t, sample_size);
+	if (queued > t->queue_peak_ns)
+		t->queue_peak_ns = queued;
+
+	if (queued <= t->queue_max_ns) {
+		t->queue_over = false;
+		// Catching up continues to the half of the limit so that it does not toggle at every tick.
+		if (t->catching_up && queued <= t->queue_max_ns / 2) {
+			t->catching_up = false;
+			t->pace_anchored = false;
 		}
-		break;
-	case VBAN_BITFMT_32_FLOAT:
-		for (uint32_t i = 0; i < pkt->frames; i++) {
-			for (size_t ch = 0; ch < channels; ch++) {
-				float v = ((float *)pkt->data[ch])[i];
-				((float *)dst)[0] = v;
-				dst += 4;
-			}
+		return;
+	}
+
+	if (!t->queue_over) {
+		t->queue_over = true;
+		blog(LOG_WARNING, "vban-out: %" PRIu64 " ms of audio are queued, exceeding the limit of %" PRIu64 " ms",
+		     queued / 1000000, t->queue_max_ns / 1000000);
+		t->cnt_queue_exceeded++;
+	}
+
+	if (t->queue_policy != VBAN_OUT_QUEUE_DROP_OLDEST) {
+		t->catching_up = true;
+		return;
+	}
+
+	uint64_t frames = (queued - t->queue_max_ns) * (uint64_t)t->frequency_src / 1000000000 + 1;
+	if (t->n_parts) {
+		uint64_t dropped = 0;
+		for (size_t k = 0; k < t->n_parts; k++) {
+			uint64_t d = drop_oldest(t->parts[k]->ring, frames);
+			if (d > dropped)
+				dropped = d;
 		}
-		break;
-	default:
-		blog(LOG_ERROR, "Cannot convert for format_bit=%d", (int)t->header->format_bit);
+		t->cnt_queue_drop_frames += dropped;
+		t->parts_aligned = false;
+	}
+	else {
+		t->pkt.frames = 0;
+		t->cnt_queue_drop_frames += drop_oldest(t->ring, frames);
+		audio_ring_peek(t->ring, &t->pkt);
+		// The timeline restarts at the next tick instead of filling the dropped audio with silence.
+		t->ts_valid = false;
 	}
 }
 
-static void vban_out_loop(struct vban_out_s *v)
+static void aggregate_mirror(struct output_thread_s *t)
 {
-	struct audio_data pkt = {0};
+	const struct output_thread_s *p0 = t->parts[0];
+	t->header->format_SR = p0->header->format_SR;
+	t->header->format_bit = p0->header->format_bit;
+	t->header->format_nbc = (uint8_t)(t->n_parts * ((size_t)p0->header->format_nbc + 1) - 1);
+	t->frequency_vban = p0->frequency_vban;
+	t->dither = p0->dither;
+	t->resampler_quality = p0->resampler_quality;
+	t->map = p0->map;
+	t->codec_opus = p0->codec_opus;
+	t->opus_frame = p0->opus_frame;
+	t->opus_bitrate = p0->opus_bitrate;
+	t->pace_anchored = false;
+}
+
+static bool aggregate_apply(struct output_thread_s *t, const struct pipeline_cfg *want)
+{
+	for (size_t k = 0; k < t->n_parts; k++) {
+		if (!pipeline_apply(t->parts[k], want))
+			return false;
+	}
+	aggregate_mirror(t);
 
-	char vban_buf[VBAN_PROTOCOL_MAX_SIZE];
+	// Frames encoded in the previous format are discarded and the tracks are aligned again.
+	t->parts_aligned = false;
+	return codec_apply(t);
+}
 
-	struct output_thread_s t = {
-		.header = (void *)vban_buf,
-		.payload = vban_buf + VBAN_HEADER_SIZE,
-		.v = v,
-	};
+/* Starts the timelines of all tracks at the latest of their first ticks
+ * so that the frames of the tracks are interleaved at the same sample. */
+static bool aggregate_align(struct output_thread_s *t)
+{
+	uint64_t start_ns = 0;
+	for (size_t k = 0; k < t->n_parts; k++) {
+		struct audio_data pkt;
+		if (!audio_ring_peek(t->parts[k]->ring, &pkt))
+			return false;
+		if (pkt.timestamp > start_ns)
+			start_ns = pkt.timestamp;
+	}
 
-	if (!thread_loop_start(&t)) {
-		blog(LOG_INFO, "Cannot start VBAN output");
-		v->cont = false;
-		return;
+	for (size_t k = 0; k < t->n_parts; k++) {
+		struct output_thread_s *p = t->parts[k];
+		p->pending.num = 0;
+		p->ts_base_ns = start_ns;
+		p->ts_frames = 0;
+		p->ts_valid = true;
 	}
 
-	unsigned long wait_ms = 100;
+	t->parts_aligned = true;
+	return true;
+}
 
-	while (v->cont) {
-		// copy of properties
-		struct sockaddr_in addr;
-		addr.sin_family = AF_INET;
+/* Encodes the next audio tick of each track and interleaves the frames that all tracks have.
+ * Returns true if any audio tick was taken. */
+static bool aggregate_fill(struct output_thread_s *t, size_t sample_size)
+{
+	if (!t->parts_aligned && !aggregate_align(t))
+		return false;
 
-		os_event_timedwait(v->event, wait_ms);
+	const size_t unit = sample_size / t->n_parts;
+	bool taken = false;
+	size_t frames = SIZE_MAX;
 
-		pthread_mutex_lock(&v->mutex);
+	for (size_t k = 0; k < t->n_parts; k++) {
+		struct output_thread_s *p = t->parts[k];
+		struct audio_data pkt;
+
+		if (audio_ring_peek(p->ring, &pkt)) {
+			uint64_t restarts = p->cnt_ts_restarts;
+			bool trimmed;
+			if (ts_align(p, &pkt, &trimmed)) {
+				p->buf_ts_ns = pkt.timestamp - p->resampler_delay_ns -
+					       (uint64_t)(p->pending.num / unit) * 1000000000 / p->frequency_vban;
+				encode_packet(p, &pkt, !trimmed);
+				ts_advance(p, pkt.frames);
+			}
+			audio_ring_pop(p->ring);
+			taken = true;
 
-		if (v->buffer.size && !pkt.frames) {
-			deque_pop_front(&v->buffer, &pkt, sizeof(pkt));
+			if (p->cnt_ts_restarts != restarts)
+				t->parts_aligned = false;
 		}
 
-		bool restart = bring_settings_unlocked(v, &t, &addr);
+		if (p->pending.num / unit < frames)
+			frames = p->pending.num / unit;
+	}
 
-		pthread_mutex_unlock(&v->mutex);
+	// The tracks are aligned again from the next ticks.
+	if (!t->parts_aligned || !frames)
+		return taken;
 
-		if (restart)
-			break;
+	const uint8_t *src[MAX_AUDIO_MIXES];
+	for (size_t k = 0; k < t->n_parts; k++)
+		src[k] = t->parts[k]->pending.array;
+
+	t->buf_ts_ns = t->parts[0]->buf_ts_ns - (uint64_t)(t->wire.len / sample_size) * 1000000000 / t->frequency_vban;
+
+	t->buffer.num = 0;
+	vban_encode_interleave_units(src, t->n_parts, unit, frames, &t->buffer);
+	wire_ring_write(&t->wire, t->buffer.array, t->buffer.num);
+
+	for (size_t k = 0; k < t->n_parts; k++) {
+		struct output_thread_s *p = t->parts[k];
+		darray_erase_range(1, &p->pending, 0, frames * unit);
+		p->buf_ts_ns += (uint64_t)frames * 1000000000 / p->frequency_vban;
+	}
+
+	return taken;
+}
+
+struct output_thread_s *vban_out_stream_create(struct vban_out_s *v, struct vban_out_track_s *track,
+					       struct vban_send_s *send)
+{
+	struct output_thread_s *t = bzalloc(sizeof(struct output_thread_s));
+	pthread_mutex_init(&t->mutex, NULL);
+	t->header = (struct VBanHeader *)t->header_buf;
+	t->v = v;
+	t->ring = track->ring;
+	t->track = track->mixer;
+	t->send = send;
+	t->inline_send.sock = INVALID_SOCKET;
+
+	if (!stream_start(t)) {
+		blog(LOG_INFO, "Cannot start VBAN output");
+		pipeline_release(t);
+		darray_free(&t->buffer);
+		bfree(t->silence);
+		bfree(t->prime);
+		pthread_mutex_destroy(&t->mutex);
+		bfree(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+struct output_thread_s *vban_out_stream_create_aggregate(struct vban_out_s *v, struct vban_send_s *send)
+{
+	struct output_thread_s *t = bzalloc(sizeof(struct output_thread_s));
+	pthread_mutex_init(&t->mutex, NULL);
+	t->header = (struct VBanHeader *)t->header_buf;
+	t->v = v;
+	t->send = send;
+	t->inline_send.sock = INVALID_SOCKET;
+
+	for (size_t i = 0; i < v->n_tracks; i++) {
+		struct output_thread_s *p = vban_out_stream_create(v, v->tracks + i, send);
+		if (!p) {
+			vban_out_stream_destroy(t);
+			return NULL;
+		}
+		p->part = true;
+		t->parts[t->n_parts++] = p;
+	}
+
+	const struct output_thread_s *p0 = t->parts[0];
+	memcpy(&t->header->vban, "VBAN", 4);
+	t->frequency_src = p0->frequency_src;
+	t->speakers = p0->speakers;
+	t->converted = p0->converted;
+	aggregate_mirror(t);
+	if (!codec_apply(t)) {
+		vban_out_stream_destroy(t);
+		return NULL;
+	}
+
+	blog(LOG_INFO, "vban-out: aggregating %zu tracks into %d channels", t->n_parts, (int)t->header->format_nbc + 1);
 
-		size_t channels = v->channels;
-		size_t fmt_size = VBanBitResolutionSize[t.header->format_bit & VBAN_BIT_RESOLUTION_MASK];
-		size_t sample_size = channels * fmt_size;
-
-		if (t.buffer.num + sample_size <= VBAN_DATA_MAX_SIZE && pkt.frames) {
-			t.buf_ts_ns =
-				pkt.timestamp - (uint64_t)(t.buffer.num / sample_size) * 1000000000 / t.frequency_vban;
-			if (t.resampler)
-				resample_from_packet(&t, &pkt);
-			else
-				convert_from_packet(&t, &pkt);
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				bfree(pkt.data[i]);
-				pkt.data[i] = NULL;
+	return t;
+}
+
+uint64_t vban_out_stream_step(struct output_thread_s *t)
+{
+	struct vban_out_s *v = t->v;
+	uint64_t wake = 0;
+
+	if (t->failed)
+		return 0;
+
+	if (!t->n_parts && !t->pkt.frames)
+		audio_ring_peek(t->ring, &t->pkt);
+
+	pthread_mutex_lock(&v->mutex);
+
+	struct pipeline_cfg want;
+	bool reconfigure = bring_settings_unlocked(v, t, &want);
+
+	pthread_mutex_unlock(&v->mutex);
+
+	size_t channels = (size_t)t->header->format_nbc + 1;
+	size_t fmt_size = vban_encode_sample_size(t->header->format_bit);
+	size_t sample_size = channels * fmt_size;
+
+	if (reconfigure) {
+		drain_wire(t, sample_size);
+		if (!(t->n_parts ? aggregate_apply(t, &want) : pipeline_apply(t, &want))) {
+			t->failed = true;
+			return 0;
+		}
+		channels = (size_t)t->header->format_nbc + 1;
+		fmt_size = vban_encode_sample_size(t->header->format_bit);
+		sample_size = channels * fmt_size;
+	}
+
+	queue_limit(t, sample_size);
+
+	// Packets queued from the ring were flushed at the end of the previous round so that it can be written.
+	if (t->wire.len + sample_size <= t->data_max && t->n_parts) {
+		// In paced and batch mode, all packets are sent below and the next audio is taken without waiting.
+		if (aggregate_fill(t, sample_size) && (t->pacing || t->batch || t->catching_up))
+			wake = 1;
+	}
+	else if (t->wire.len + sample_size <= t->data_max && t->pkt.frames) {
+		bool trimmed;
+		if (ts_align(t, &t->pkt, &trimmed)) {
+			if (!gate_suppress(t, &t->pkt, sample_size)) {
+				// The samples coming out of the resampler are older than the input by its delay.
+				t->buf_ts_ns = t->pkt.timestamp - t->resampler_delay_ns -
+					       (uint64_t)(t->wire.len / sample_size) * 1000000000 / t->frequency_vban;
+				encode_packet(t, &t->pkt, !trimmed);
 			}
-			pkt.frames = 0;
+			ts_advance(t, t->pkt.frames);
+		}
+		audio_ring_pop(t->ring);
+		t->pkt.frames = 0;
+
+		// In paced and batch mode, all packets are sent below and the next audio is taken without waiting.
+		if (t->pacing || t->batch || t->catching_up)
+			wake = 1;
+	}
+
+	// Packets that the inline path could not send go out before the following ones.
+	if (t->inline_send.n_pkts)
+		vban_send_flush(&t->inline_send);
+
+	size_t nbs;
+	while ((nbs = ready_packet_samples(t, sample_size))) {
+		uint64_t pkt_ns = (uint64_t)nbs * 1000000000 / t->frequency_vban;
+		uint64_t target_ns = 0;
+		bool spaced = !t->pacing && !t->batch;
+		// The worker also wakes for the other streams, so the spacing is kept by the stream itself.
+		if (spaced && !t->catching_up && t->next_send_ns && os_gettime_ns() < t->next_send_ns)
+			return earliest(wake, t->next_send_ns);
+		// While catching up, the backlog is sent without waiting and the pacing is anchored again afterwards.
+		if (t->pacing && !t->catching_up) {
+			target_ns = pace_target_ns(t, t->buf_ts_ns + pkt_ns);
+			uint64_t lookahead_ns = 0;
+			if (t->txtime)
+				lookahead_ns = t->batch ? TXTIME_BATCH_LOOKAHEAD_NS : TXTIME_LOOKAHEAD_NS;
+
+			// The worker calls again when the packet is due.
+			if (target_ns - lookahead_ns > os_gettime_ns())
+				return earliest(wake, target_ns - lookahead_ns);
 		}
 
-		size_t nbs = t.buffer.num / sample_size;
-		if (nbs >= 256 || t.buffer.num + sample_size > VBAN_DATA_MAX_SIZE) {
-			if (nbs * sample_size > VBAN_DATA_MAX_SIZE)
-				nbs = VBAN_DATA_MAX_SIZE / sample_size;
-			if (nbs > 256)
-				nbs = 256;
-			t.header->format_nbs = (uint8_t)(nbs - 1);
-			size_t n = nbs * sample_size;
-			memcpy(t.payload, t.buffer.array, n);
-			memmove(t.buffer.array, (char *)t.buffer.array + n, t.buffer.num - n);
-			t.buffer.num -= n;
-			sendto(t.vban_socket, vban_buf, VBAN_HEADER_SIZE + n, 0, (struct sockaddr *)&addr,
-			       (socklen_t)sizeof(addr));
+		send_packet(t, t->send, nbs, sample_size, t->txtime ? target_ns : 0);
+		// The socket of the worker is batched for the streams that ask for it; the others submit each packet.
+		if (!t->batch)
+			vban_send_flush(t->send);
+
+		// With SO_TXTIME, the actual departure is not observable from here.
+		if (target_ns && !t->txtime)
+			pace_record(t, target_ns);
+		t->buf_ts_ns += pkt_ns;
 
 #ifdef DEBUG_PACKET
-			blog(LOG_DEBUG, "sent packet nuFrame: %d", t.header->nuFrame);
+		blog(LOG_DEBUG, "sent packet nuFrame: %d", t->header->nuFrame);
 #endif
 
-			t.header->nuFrame++;
-			wait_ms = (unsigned long)nbs * 1000 / t.frequency_vban;
+		t->header->nuFrame++;
+
+		/* The next packet is sent after the duration of this packet
+		 * unless more than an audio tick is waiting, e.g. after silence was inserted. */
+		if (spaced) {
+			bool backlog = t->wire.len > t->buffer.capacity || t->catching_up;
+			t->next_send_ns = backlog ? 0 : os_gettime_ns() + pkt_ns;
+			return earliest(wake, backlog ? 1 : t->next_send_ns);
 		}
 	}
 
-	blog(LOG_INFO, "Total number of output packets: %" PRIu32, t.header->nuFrame);
+	return wake;
+}
+
+static void log_stream_stats(const struct output_thread_s *t)
+{
+	blog(LOG_INFO, "Total number of output packets: %" PRIu32, t->header->nuFrame);
+	if (t->encode_cnt)
+		blog(LOG_INFO, "Encoding took %.2f us per audio tick on average%s",
+		     (double)t->encode_ns * 1e-3 / (double)t->encode_cnt, t->converted ? " (converted by libobs)" : "");
+	if (t->pace_cnt) {
+		blog(LOG_INFO,
+		     "Paced %" PRIu64 " packets, departure error mean %" PRIu64 " us, min %" PRId64 " us, max %" PRId64
+		     " us",
+		     t->pace_cnt, t->pace_err_abs_sum_ns / t->pace_cnt / 1000, t->pace_err_min_ns / 1000,
+		     t->pace_err_max_ns / 1000);
+	}
+
+	if (t->cnt_ts_gaps || t->cnt_ts_overlaps || t->cnt_ts_restarts)
+		blog(LOG_INFO,
+		     "Audio timeline: %" PRIu64 " gaps filled with %" PRIu64 " frames of silence, %" PRIu64
+		     " overlaps trimmed by %" PRIu64 " frames, %" PRIu64 " restarts",
+		     t->cnt_ts_gaps, t->cnt_ts_gap_frames, t->cnt_ts_overlaps, t->cnt_ts_overlap_frames,
+		     t->cnt_ts_restarts);
+
+	if (t->cnt_fec_parity)
+		blog(LOG_INFO, "Sent %" PRIu64 " parity packets", t->cnt_fec_parity);
 
-	if (t.resampler)
-		audio_resampler_destroy(t.resampler);
-	for (size_t i = 0; i < MAX_AV_PLANES; i++)
-		bfree(pkt.data[i]);
-	closesocket(t.vban_socket);
-	darray_free(&t.buffer);
+	if (t->cnt_opus_packets) {
+		// Compared with the payload of 24-bit integer for the same audio
+		uint64_t frames = t->cnt_opus_packets * t->opus_frame;
+		uint64_t pcm_bytes = frames * ((uint64_t)t->header->format_nbc + 1) * 3;
+		blog(LOG_INFO,
+		     "Opus: %" PRIu64 " packets, %.1f kbit/s on average, %.1f%% of 24-bit PCM,"
+		     " encoding took %.2f us per packet",
+		     t->cnt_opus_packets, (double)t->cnt_opus_bytes * 8e-3 * t->frequency_vban / (double)frames,
+		     (double)t->cnt_opus_bytes * 100.0 / (double)pcm_bytes,
+		     (double)t->opus_ns * 1e-3 / (double)t->cnt_opus_packets);
+	}
+
+	if (t->cnt_queue_exceeded)
+		blog(LOG_INFO,
+		     "Queue: exceeded the limit %" PRIu64 " times, %" PRIu64 " frames dropped, peak %" PRIu64 " ms",
+		     t->cnt_queue_exceeded, t->cnt_queue_drop_frames, t->queue_peak_ns / 1000000);
+
+	if (t->cnt_gate_closes)
+		blog(LOG_INFO,
+		     "Silence gate: closed %" PRIu64 " times, %" PRIu64 " packets suppressed, %" PRIu64
+		     " keepalive ticks",
+		     t->cnt_gate_closes,
+		     t->cnt_gate_frames * (uint64_t)t->frequency_vban / (uint64_t)t->frequency_src / t->nbs_max,
+		     t->cnt_gate_keepalives);
+
+	long cnt_inline_fallback = os_atomic_load_long(&t->cnt_inline_fallback);
+	if (t->cnt_inline || cnt_inline_fallback)
+		blog(LOG_INFO, "Sent %" PRIu64 " audio ticks from the audio thread, %ld by the worker", t->cnt_inline,
+		     cnt_inline_fallback);
+}
+
+void vban_out_stream_destroy(struct output_thread_s *t)
+{
+	struct vban_out_s *v = t->v;
+
+	for (size_t k = 0; k < t->n_parts; k++) {
+		struct output_thread_s *p = t->parts[k];
+		t->encode_ns += p->encode_ns;
+		t->encode_cnt += p->encode_cnt;
+		t->cnt_ts_gaps += p->cnt_ts_gaps;
+		t->cnt_ts_gap_frames += p->cnt_ts_gap_frames;
+		t->cnt_ts_overlaps += p->cnt_ts_overlaps;
+		t->cnt_ts_overlap_frames += p->cnt_ts_overlap_frames;
+		t->cnt_ts_restarts += p->cnt_ts_restarts;
+		vban_out_stream_destroy(p);
+	}
+
+	pthread_mutex_lock(&v->mutex);
+	sync_dests_unlocked(v, t);
+	sync_stats_unlocked(v, t);
+	pthread_mutex_unlock(&v->mutex);
+
+	// The statistics of the parts are reported by the aggregation.
+	if (!t->part)
+		log_stream_stats(t);
+
+	if (valid_socket(t->inline_send.sock))
+		vban_send_close(&t->inline_send);
+	pipeline_release(t);
+	darray_free(&t->buffer);
+	darray_free(&t->pending);
+	wire_ring_free(&t->wire);
+	bfree(t->silence);
+	bfree(t->prime);
+	pthread_mutex_destroy(&t->mutex);
+	bfree(t);
+}
+
+bool vban_out_stream_wants_txtime(const struct output_thread_s *t)
+{
+	return t->txtime_wanted;
+}
+
+void vban_out_stream_lock(struct output_thread_s *t)
+{
+	pthread_mutex_lock(&t->mutex);
+}
+
+void vban_out_stream_unlock(struct output_thread_s *t)
+{
+	pthread_mutex_unlock(&t->mutex);
 }
 
-void *vban_out_thread_main(void *data)
+bool vban_out_stream_inline(struct output_thread_s *t, const struct audio_data *frames)
 {
-	os_set_thread_name("vban-out");
-	struct vban_out_s *v = data;
+	struct vban_out_s *v = t->v;
+	uint64_t start_ns = os_gettime_ns();
+
+	if (!t->inline_ok || start_ns < t->inline_resume_ns)
+		return false;
+
+	// The worker is in a round, or the stream is being reconfigured.
+	if (pthread_mutex_trylock(&t->mutex) != 0) {
+		os_atomic_inc_long(&t->cnt_inline_fallback);
+		return false;
+	}
+
+	size_t sample_size = ((size_t)t->header->format_nbc + 1) * vban_encode_sample_size(t->header->format_bit);
+
+	/* Audio queued for the worker has to go out first, and the wire buffer must not grow here.
+	 * The worker sends the first audio tick, which allocates the wire buffer, and fills gaps with silence. */
+	if (!t->inline_ok || t->failed || t->pkt.frames || !audio_ring_empty(t->ring) || t->inline_send.n_pkts ||
+	    t->wire.size - t->wire.len < t->buffer.capacity || !ts_continuous(t, frames)) {
+		pthread_mutex_unlock(&t->mutex);
+		os_atomic_inc_long(&t->cnt_inline_fallback);
+		return false;
+	}
+
+	if (!gate_suppress(t, frames, sample_size)) {
+		t->buf_ts_ns = frames->timestamp - t->resampler_delay_ns -
+			       (uint64_t)(t->wire.len / sample_size) * 1000000000 / t->frequency_vban;
+		encode_packet(t, frames, true);
+	}
+	ts_advance(t, frames->frames);
+
+	bool fallback = false;
+	size_t nbs;
+	while ((nbs = ready_packet_samples(t, sample_size))) {
+		// The remaining packets stay in the wire buffer and the worker sends them.
+		if (os_gettime_ns() - start_ns > INLINE_BUDGET_NS) {
+			fallback = true;
+			break;
+		}
 
-	while (v->cont) {
-		vban_out_loop(v);
+		send_packet(t, &t->inline_send, nbs, sample_size, 0);
+		t->buf_ts_ns += (uint64_t)nbs * 1000000000 / t->frequency_vban;
+		t->header->nuFrame++;
 	}
 
-	return NULL;
+	/* The payload refers to the wire buffer, which is written again once unlocked.
+	 * Packets that do not fit the socket buffer are kept with their payloads copied and the worker sends them. */
+	vban_send_flush(&t->inline_send);
+	if (t->inline_send.blocked)
+		fallback = true;
+
+	if (fallback)
+		t->inline_resume_ns = os_gettime_ns() + INLINE_BACKOFF_NS;
+	t->cnt_inline++;
+
+	pthread_mutex_unlock(&t->mutex);
+
+	if (fallback && v->wake)
+		os_event_signal(v->wake);
+
+	return true;
 }
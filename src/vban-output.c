@@ -17,6 +17,8 @@
  */
 
 #include <obs-module.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 #include <util/platform.h>
 #include <util/threading.h>
@@ -24,6 +26,11 @@
 #include "vban.h"
 #include "vban-output-internal.h"
 #include "resolve-thread.h"
+#include "vban-resampler.h"
+#include "vban-encode.h"
+#include "vban-fec.h"
+#include "vban-opus.h"
+#include "vban-out-sched.h"
 
 #if LIBOBS_API_VER < MAKE_SEMANTIC_VERSION(30, 1, 0)
 #define AUDIO_ONLY_WORKAROUND
@@ -35,23 +42,116 @@ static const char *vban_out_get_name(void *type_data)
 	return obs_module_text("VBAN.out");
 }
 
+/* Requests libobs to deliver the audio in the format to send if enabled,
+ * otherwise in the format of OBS Studio since the request cannot be withdrawn. */
+static void set_audio_conversion(struct vban_out_s *v, const struct audio_output_info *aoi)
+{
+	struct audio_convert_info conv = {
+		.samples_per_sec = aoi->samples_per_sec,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers = aoi->speakers,
+	};
+
+	pthread_mutex_lock(&v->mutex);
+	v->conv.opus = v->codec == VBAN_OUT_CODEC_OPUS;
+	v->conv.format_bit = v->conv.opus ? VBAN_BITFMT_32_FLOAT : v->format_bit;
+	v->conv.active = v->obs_conversion &&
+			 vban_encode_interleaved_format(v->conv.format_bit) != AUDIO_FORMAT_UNKNOWN;
+	v->conv.frequency = v->frequency ? v->frequency : (int)aoi->samples_per_sec;
+	if (v->conv.opus && !vban_opus_rate_supported(v->conv.frequency))
+		v->conv.frequency = 48000;
+	pthread_mutex_unlock(&v->mutex);
+
+	if (v->conv.active) {
+		conv.samples_per_sec = (uint32_t)v->conv.frequency;
+		conv.format = vban_encode_interleaved_format(v->conv.format_bit);
+		blog(LOG_INFO, "vban_out_start: libobs converts the audio to %d Hz, format_bit=%d", v->conv.frequency,
+		     (int)v->conv.format_bit);
+	}
+
+	obs_output_set_audio_conversion(v->context, &conv);
+}
+
+static void destroy_tracks(struct vban_out_s *v)
+{
+	for (size_t i = 0; i < v->n_tracks; i++) {
+		struct vban_out_track_s *tr = v->tracks + i;
+		if (tr->ring && audio_ring_overruns(tr->ring))
+			blog(LOG_WARNING,
+			     "vban_out_stop: %ld audio chunk(s) of track %d were dropped"
+			     " since the transmit scheduler was late",
+			     audio_ring_overruns(tr->ring), (int)tr->mixer + 1);
+		audio_ring_destroy(tr->ring);
+		tr->ring = NULL;
+	}
+	v->n_tracks = 0;
+}
+
 static bool vban_out_start(void *data)
 {
 	struct vban_out_s *v = data;
 
+	const struct audio_output_info *aoi;
 	if (v->context) {
 		audio_t *audio = obs_output_audio(v->context);
 		v->channels = audio_output_get_channels(audio);
+		aoi = audio_output_get_info(audio);
 	}
 	else {
-		const struct audio_output_info *aoi = audio_output_get_info(obs_get_audio());
+		aoi = audio_output_get_info(obs_get_audio());
 		v->channels = get_audio_channels(aoi->speakers);
 	}
 
-	v->cont = true;
-	pthread_create(&v->thread, NULL, vban_out_thread_main, v);
+	if (v->context)
+		set_audio_conversion(v, aoi);
 
-	blog(LOG_INFO, "vban_out_start: starting... channels=%d", (int)v->channels);
+	// A filter sends the audio of its source, which is not a mixer track.
+	pthread_mutex_lock(&v->mutex);
+	uint32_t mixers = v->context ? v->mixers : 1;
+	pthread_mutex_unlock(&v->mutex);
+
+	if (!mixers) {
+		blog(LOG_ERROR, "vban_out_start: no track is checked");
+		return false;
+	}
+
+	v->n_tracks = 0;
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if (!(mixers & (1 << i)))
+			continue;
+
+		struct vban_out_track_s *tr = v->tracks + v->n_tracks++;
+		tr->mixer = i;
+		if (v->conv.active) {
+			enum audio_format format = vban_encode_interleaved_format(v->conv.format_bit);
+			size_t frame_bytes = v->channels * get_audio_bytes_per_channel(format);
+			tr->ring = audio_ring_create(1, frame_bytes, v->conv.frequency, AUDIO_OUTPUT_FRAMES,
+						     VBAN_OUT_RING_SLOTS);
+		}
+		else {
+			tr->ring = audio_ring_create(v->channels, sizeof(float), aoi->samples_per_sec,
+						     AUDIO_OUTPUT_FRAMES, VBAN_OUT_RING_SLOTS);
+		}
+		if (!tr->ring) {
+			blog(LOG_ERROR, "vban_out_start: failed to allocate buffer for %d channels", (int)v->channels);
+			destroy_tracks(v);
+			return false;
+		}
+	}
+
+	pthread_mutex_lock(&v->mutex);
+	v->aggregated = v->aggregate && v->n_tracks > 1;
+	memset(&v->tx, 0, sizeof(v->tx));
+	v->cnt_frames = 0;
+	pthread_mutex_unlock(&v->mutex);
+
+	if (!vban_sched_add(v)) {
+		destroy_tracks(v);
+		return false;
+	}
+
+	blog(LOG_INFO, "vban_out_start: starting... channels=%d tracks=%d", (int)v->channels, (int)v->n_tracks);
+	os_atomic_set_bool(&v->accepting, true);
 
 	if (v->context) {
 		obs_output_begin_data_capture(v->context, OBS_OUTPUT_VIDEO | OBS_OUTPUT_AUDIO);
@@ -60,6 +160,31 @@ static bool vban_out_start(void *data)
 	return true;
 }
 
+static void log_tx_stats(const struct vban_send_stats_s *tx, uint64_t frames)
+{
+	if (tx->cnt_packets)
+		blog(LOG_INFO,
+		     "vban_out_stop: sent %" PRIu64 " packets, %" PRIu64 " bytes, %" PRIu64
+		     " frames; waited %.1f us on average and %.1f us at most until given to the socket",
+		     tx->cnt_packets, tx->cnt_bytes, frames,
+		     (double)tx->latency_sum_ns * 1e-3 / (double)tx->cnt_packets,
+		     (double)tx->latency_max_ns * 1e-3);
+
+	uint64_t dropped = vban_send_stats_dropped(tx);
+	if (!dropped)
+		return;
+
+	char causes[256] = "";
+	size_t len = 0;
+	for (int i = 0; i < VBAN_SEND_ERR_MAX && len < sizeof(causes); i++) {
+		if (tx->cnt_errors[i])
+			len += snprintf(causes + len, sizeof(causes) - len, "%s%s %" PRIu64, len ? ", " : "",
+					vban_send_error_name(i), tx->cnt_errors[i]);
+	}
+	blog(LOG_WARNING, "vban_out_stop: %" PRIu64 " packets could not be sent: %s; the last error was %d", dropped,
+	     causes, tx->last_errno);
+}
+
 static void vban_out_stop(void *data, uint64_t ts)
 {
 	struct vban_out_s *v = data;
@@ -68,32 +193,65 @@ static void vban_out_stop(void *data, uint64_t ts)
 	if (v->context)
 		obs_output_end_data_capture(v->context);
 
-	v->cont = false;
-	os_event_signal(v->event);
-	pthread_join(v->thread, NULL);
+	if (!v->n_tracks)
+		return;
+
+	/* libobs disconnects the audio asynchronously, so that the callbacks may still be running.
+	 * The tracks are released after all callbacks have left. */
+	os_atomic_set_bool(&v->accepting, false);
+	while (os_atomic_load_long(&v->audio_users) > 0)
+		os_sleep_ms(1);
+
+	vban_sched_remove(v);
+	destroy_tracks(v);
+
+	pthread_mutex_lock(&v->mutex);
+	for (size_t i = 0; i < v->dests.num; i++) {
+		const struct vban_out_dest_s *d = v->dests.array + i;
+		blog(LOG_INFO, "vban_out_stop: destination '%s:%d': %" PRIu64 " packets, %" PRIu64 " bytes", d->host,
+		     d->port, d->cnt_packets, d->cnt_bytes);
+	}
+	log_tx_stats(&v->tx, v->cnt_frames);
+	pthread_mutex_unlock(&v->mutex);
 
 	blog(LOG_INFO, "vban_out_stop: stopped");
 
 	UNUSED_PARAMETER(ts);
 }
 
-static void vban_out_raw_audio(void *data, struct audio_data *frames)
+static void vban_out_raw_audio2(void *data, size_t mix_idx, struct audio_data *frames)
 {
 	struct vban_out_s *v = data;
 
-	struct audio_data pkt = *frames;
-	for (size_t i = 0; i < v->channels; i++)
-		pkt.data[i] = bmemdup(frames->data[i], pkt.frames * sizeof(float));
-	for (size_t i = v->channels; i < MAX_AV_PLANES; i++)
-		pkt.data[i] = NULL;
+	// Called from the audio thread. Neither allocate memory nor lock the mutex.
+	if (!vban_out_audio_enter(v))
+		return;
+
+	for (size_t i = 0; i < v->n_tracks; i++) {
+		struct vban_out_track_s *tr = v->tracks + i;
+		if (tr->mixer != mix_idx || !tr->ring)
+			continue;
 
-	pthread_mutex_lock(&v->mutex);
+		audio_ring_push(tr->ring, (const uint8_t *const *)frames->data, frames->frames, frames->timestamp);
 
-	deque_push_back(&v->buffer, &pkt, sizeof(pkt));
+		if (v->wake)
+			os_event_signal(v->wake);
+		break;
+	}
 
-	os_event_signal(v->event);
+	vban_out_audio_leave(v);
+}
 
-	pthread_mutex_unlock(&v->mutex);
+static void vban_out_raw_audio(void *data, struct audio_data *frames)
+{
+	struct vban_out_s *v = data;
+
+	// Called from the filter, which has one track.
+	if (!vban_out_audio_enter(v))
+		return;
+	if (v->n_tracks)
+		vban_out_raw_audio2(data, v->tracks[0].mixer, frames);
+	vban_out_audio_leave(v);
 }
 
 static bool update_string(char **opt, obs_data_t *settings, const char *name)
@@ -107,25 +265,122 @@ static bool update_string(char **opt, obs_data_t *settings, const char *name)
 	return false;
 }
 
-static void vban_out_update_ip_to(struct vban_out_s *v, const char *ip_to)
+static void dest_free(struct vban_out_dest_s *d)
 {
-	if (v->rt) {
-		resolve_thread_release(v->rt);
-		v->rt = NULL;
+	if (d->rc) {
+		resolve_cache_release(d->rc);
+		d->rc = NULL;
 	}
+	bfree(d->host);
+	bfree(d->stream_name);
+}
+
+static void dest_set_host(struct vban_out_dest_s *d, const char *host)
+{
+	d->host = bstrdup(host);
 
 	struct in_addr addr = {0};
-	if (inet_pton(AF_INET, ip_to, &addr)) {
-		v->ip_to.s_addr = addr.s_addr;
+	if (inet_pton(AF_INET, host, &addr)) {
+		d->addr.s_addr = addr.s_addr;
+		return;
+	}
+
+	// The address is taken from the cache by the stream when resolved.
+	d->rc = resolve_cache_get(host);
+}
+
+static inline bool streq_null(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+static void add_dest(struct vban_out_s *v, struct darray *old_dests, const char *host, int port,
+		     const char *stream_name)
+{
+	if (v->dests.num >= VBAN_OUT_DEST_MAX) {
+		blog(LOG_WARNING, "Too many destinations, ignoring '%s'", host);
 		return;
 	}
 
-	v->rt = resolve_thread_create(ip_to);
-	if (!v->rt)
+	struct vban_out_dest_s *d = da_push_back_new(v->dests);
+
+	// Keep the resolved address and the statistics if the destination did not change.
+	struct vban_out_dest_s *old = old_dests->array;
+	for (size_t i = 0; i < old_dests->num; i++) {
+		if (old[i].host && strcmp(old[i].host, host) == 0 && old[i].port == port &&
+		    streq_null(old[i].stream_name, stream_name)) {
+			*d = old[i];
+			old[i].host = NULL;
+			old[i].stream_name = NULL;
+			old[i].rc = NULL;
+			return;
+		}
+	}
+
+	d->port = port;
+	d->stream_name = stream_name ? bstrdup(stream_name) : NULL;
+	dest_set_host(d, host);
+}
+
+/* Parse a destination in the form of `host[:port][/stream_name]`. */
+static void add_dest_str(struct vban_out_s *v, struct darray *old_dests, const char *str)
+{
+	char host[256];
+	snprintf(host, sizeof(host), "%s", str);
+
+	const char *stream_name = NULL;
+	char *slash = strchr(host, '/');
+	if (slash) {
+		*slash = 0;
+		if (slash[1])
+			stream_name = slash + 1;
+	}
+
+	int port = v->port;
+	char *colon = strrchr(host, ':');
+	if (colon) {
+		*colon = 0;
+		port = atoi(colon + 1);
+		if (port <= 0 || port > 65535) {
+			blog(LOG_WARNING, "Invalid port number in destination '%s'", str);
+			return;
+		}
+	}
+
+	if (!*host)
 		return;
 
-	blog(LOG_DEBUG, "Resolving host name '%s'", ip_to);
-	resolve_thread_start(v->rt);
+	add_dest(v, old_dests, host, port, stream_name);
+}
+
+static void vban_out_update_dests(struct vban_out_s *v, obs_data_t *settings)
+{
+	struct darray old_dests = v->dests.da;
+	da_init(v->dests);
+
+	// The first destination is always from the primary properties.
+	const char *ip_to = obs_data_get_string(settings, "ip_to");
+	add_dest(v, &old_dests, ip_to ? ip_to : "", v->port, NULL);
+
+	obs_data_array_t *arr = obs_data_get_array(settings, "destinations");
+	size_t n = arr ? obs_data_array_count(arr) : 0;
+	for (size_t i = 0; i < n; i++) {
+		obs_data_t *item = obs_data_array_item(arr, i);
+		const char *str = obs_data_get_string(item, "value");
+		if (str && *str)
+			add_dest_str(v, &old_dests, str);
+		obs_data_release(item);
+	}
+	obs_data_array_release(arr);
+
+	struct vban_out_dest_s *old = old_dests.array;
+	for (size_t i = 0; i < old_dests.num; i++)
+		dest_free(old + i);
+	darray_free(&old_dests);
+
+	v->dests_gen++;
 }
 
 static void vban_out_update(void *data, obs_data_t *settings)
@@ -136,25 +391,91 @@ static void vban_out_update(void *data, obs_data_t *settings)
 
 	v->port = (int)obs_data_get_int(settings, "port");
 	update_string(&v->stream_name, settings, "stream_name");
-	const char *ip_to = obs_data_get_string(settings, "ip_to");
-	if (ip_to && *ip_to) {
-		vban_out_update_ip_to(v, ip_to);
-	}
+	vban_out_update_dests(v, settings);
 
-	if (v->context) {
-		size_t mixer = (size_t)obs_data_get_int(settings, "mixer") - 1;
-		obs_output_set_mixer(v->context, mixer);
+	uint32_t mixers = 0;
+	bool tracks_saved = false;
+	for (int i = 0; i < MAX_AUDIO_MIXES; i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "track%d", i + 1);
+		if (obs_data_has_user_value(settings, name))
+			tracks_saved = true;
+		if (obs_data_get_bool(settings, name))
+			mixers |= 1 << i;
 	}
+	if (!tracks_saved) {
+		// Settings saved with a single track, or not saved yet
+		int mixer = (int)obs_data_get_int(settings, "mixer");
+		if (mixer < 1 || mixer > MAX_AUDIO_MIXES)
+			mixer = 1;
+		mixers = 1 << (mixer - 1);
+	}
+	v->mixers = mixers;
+	if (v->context)
+		obs_output_set_mixers(v->context, mixers);
 
 	v->frequency = (int)obs_data_get_int(settings, "frequency");
+	v->resampler_quality = (int)obs_data_get_int(settings, "resampler_quality");
 	v->format_bit = (uint8_t)obs_data_get_int(settings, "format_bit");
+	v->dither = obs_data_get_bool(settings, "dither");
+#ifdef HAVE_OPUS
+	v->codec = (int)obs_data_get_int(settings, "codec");
+#else
+	v->codec = VBAN_OUT_CODEC_PCM;
+#endif
+	v->opus_bitrate = (int)obs_data_get_int(settings, "opus_bitrate");
+	v->samples_per_packet = (int)obs_data_get_int(settings, "samples_per_packet");
+	v->latency_ms = (int)obs_data_get_int(settings, "latency_ms");
+	v->pacing = obs_data_get_bool(settings, "pacing");
+	v->txtime = obs_data_get_bool(settings, "txtime");
+	v->batch = obs_data_get_bool(settings, "batch");
+	v->fec_group = (int)obs_data_get_int(settings, "fec_group");
+	v->max_queue_ms = (int)obs_data_get_int(settings, "max_queue_ms");
+	v->queue_policy = (int)obs_data_get_int(settings, "queue_policy");
+	v->silence_gate = obs_data_get_bool(settings, "silence_gate");
+	v->silence_hold_ms = (int)obs_data_get_int(settings, "silence_hold_ms");
+	v->obs_conversion = obs_data_get_bool(settings, "obs_conversion");
+	v->inline_send = obs_data_get_bool(settings, "inline_send");
+	v->aggregate = obs_data_get_bool(settings, "aggregate");
+
+	const char *channel_map = obs_data_get_string(settings, "channel_map");
+	if (!vban_encode_parse_channel_map(&v->channel_map, channel_map))
+		blog(LOG_WARNING, "Invalid channel map '%s', sending all channels", channel_map);
 
 	pthread_mutex_unlock(&v->mutex);
 }
 
+static bool samples_per_packet_modified(obs_properties_t *props, obs_property_t *prop, obs_data_t *settings)
+{
+	UNUSED_PARAMETER(prop);
+	bool is_auto = obs_data_get_int(settings, "samples_per_packet") == 0;
+	obs_property_set_visible(obs_properties_get(props, "latency_ms"), is_auto);
+	return true;
+}
+
+#ifdef HAVE_OPUS
+static bool codec_modified(obs_properties_t *props, obs_property_t *prop, obs_data_t *settings)
+{
+	UNUSED_PARAMETER(prop);
+	bool opus = obs_data_get_int(settings, "codec") == VBAN_OUT_CODEC_OPUS;
+	obs_property_set_visible(obs_properties_get(props, "format_bit"), !opus);
+	obs_property_set_visible(obs_properties_get(props, "dither"), !opus);
+	obs_property_set_visible(obs_properties_get(props, "opus_bitrate"), opus);
+	return true;
+}
+#endif
+
+static bool silence_gate_modified(obs_properties_t *props, obs_property_t *prop, obs_data_t *settings)
+{
+	UNUSED_PARAMETER(prop);
+	bool gate = obs_data_get_bool(settings, "silence_gate");
+	obs_property_set_visible(obs_properties_get(props, "silence_hold_ms"), gate);
+	return true;
+}
+
 static obs_properties_t *vban_out_get_properties(void *data)
 {
-	UNUSED_PARAMETER(data);
+	const struct vban_out_s *v = data;
 
 	obs_properties_t *props = obs_properties_create();
 	obs_property_t *prop;
@@ -162,7 +483,17 @@ static obs_properties_t *vban_out_get_properties(void *data)
 	obs_properties_add_int(props, "port", obs_module_text("VBAN.out.prop.port"), 1, 65535, 1);
 	obs_properties_add_text(props, "stream_name", obs_module_text("VBAN.out.prop.stream_name"), OBS_TEXT_DEFAULT);
 	obs_properties_add_text(props, "ip_to", obs_module_text("VBAN.out.prop.ip_to"), OBS_TEXT_DEFAULT);
-	obs_properties_add_int(props, "mixer", obs_module_text("VBAN.out.prop.mixer"), 1, MAX_AUDIO_MIXES, 1);
+	obs_properties_add_editable_list(props, "destinations", obs_module_text("VBAN.out.prop.destinations"),
+					 OBS_EDITABLE_LIST_TYPE_STRINGS, NULL, NULL);
+	obs_properties_t *tracks = obs_properties_create();
+	for (int i = 0; i < MAX_AUDIO_MIXES; i++) {
+		char name[16], desc[32];
+		snprintf(name, sizeof(name), "track%d", i + 1);
+		snprintf(desc, sizeof(desc), obs_module_text("VBAN.out.prop.track"), i + 1);
+		obs_properties_add_bool(tracks, name, desc);
+	}
+	obs_properties_add_bool(tracks, "aggregate", obs_module_text("VBAN.out.prop.aggregate"));
+	obs_properties_add_group(props, "tracks", obs_module_text("VBAN.out.prop.tracks"), OBS_GROUP_NORMAL, tracks);
 	prop = obs_properties_add_list(props, "frequency", obs_module_text("VBAN.out.prop.frequency"),
 				       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.frequency.default"), 0);
@@ -173,11 +504,80 @@ static obs_properties_t *vban_out_get_properties(void *data)
 		obs_property_list_add_int(prop, name, f);
 	}
 
+	prop = obs_properties_add_list(props, "resampler_quality", obs_module_text("VBAN.out.prop.resampler_quality"),
+				       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.resampler_quality.low_latency"),
+				  VBAN_RESAMPLER_LOW_LATENCY);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.resampler_quality.balanced"),
+				  VBAN_RESAMPLER_BALANCED);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.resampler_quality.high_quality"),
+				  VBAN_RESAMPLER_HIGH_QUALITY);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.resampler_quality.libobs"),
+				  VBAN_RESAMPLER_LIBOBS);
+
+#ifdef HAVE_OPUS
+	prop = obs_properties_add_list(props, "codec", obs_module_text("VBAN.out.prop.codec"), OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.codec.pcm"), VBAN_OUT_CODEC_PCM);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.codec.opus"), VBAN_OUT_CODEC_OPUS);
+	obs_property_set_modified_callback(prop, codec_modified);
+	obs_properties_add_int(props, "opus_bitrate", obs_module_text("VBAN.out.prop.opus_bitrate"), 6, 256, 2);
+#endif
+
 	prop = obs_properties_add_list(props, "format_bit", obs_module_text("VBAN.out.prop.format_bit"),
 				       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.format_bit.int8"), VBAN_BITFMT_8_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.format_bit.int10"), VBAN_BITFMT_10_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.format_bit.int12"), VBAN_BITFMT_12_INT);
 	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.format_bit.int16"), VBAN_BITFMT_16_INT);
 	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.format_bit.int24"), VBAN_BITFMT_24_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.format_bit.int32"), VBAN_BITFMT_32_INT);
 	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.format_bit.flt32"), VBAN_BITFMT_32_FLOAT);
+	obs_properties_add_bool(props, "dither", obs_module_text("VBAN.out.prop.dither"));
+	obs_properties_add_text(props, "channel_map", obs_module_text("VBAN.out.prop.channel_map"), OBS_TEXT_DEFAULT);
+	// Filters receive the audio of their source, which libobs does not convert.
+	if (!v || v->context)
+		obs_properties_add_bool(props, "obs_conversion", obs_module_text("VBAN.out.prop.obs_conversion"));
+
+	prop = obs_properties_add_list(props, "samples_per_packet", obs_module_text("VBAN.out.prop.samples_per_packet"),
+				       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.samples_per_packet.auto"), 0);
+	for (int nbs = 16; nbs <= 256; nbs *= 2) {
+		char name[16];
+		snprintf(name, sizeof(name) - 1, "%d", nbs);
+		obs_property_list_add_int(prop, name, nbs);
+	}
+	obs_property_set_modified_callback(prop, samples_per_packet_modified);
+	obs_properties_add_int(props, "latency_ms", obs_module_text("VBAN.out.prop.latency_ms"), 1, 20, 1);
+
+	prop = obs_properties_add_list(props, "fec_group", obs_module_text("VBAN.out.prop.fec_group"),
+				       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.fec_group.off"), 0);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.fec_group.duplicate"), 1);
+	for (int n = 2; n <= VBAN_FEC_GROUP_MAX; n *= 2) {
+		char name[64];
+		snprintf(name, sizeof(name), obs_module_text("VBAN.out.prop.fec_group.parity"), n);
+		obs_property_list_add_int(prop, name, n);
+	}
+
+	obs_properties_add_int(props, "max_queue_ms", obs_module_text("VBAN.out.prop.max_queue_ms"), 20, 500, 10);
+	prop = obs_properties_add_list(props, "queue_policy", obs_module_text("VBAN.out.prop.queue_policy"),
+				       OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.queue_policy.catch_up"),
+				  VBAN_OUT_QUEUE_CATCH_UP);
+	obs_property_list_add_int(prop, obs_module_text("VBAN.out.prop.queue_policy.drop_oldest"),
+				  VBAN_OUT_QUEUE_DROP_OLDEST);
+
+	prop = obs_properties_add_bool(props, "silence_gate", obs_module_text("VBAN.out.prop.silence_gate"));
+	obs_property_set_modified_callback(prop, silence_gate_modified);
+	obs_properties_add_int(props, "silence_hold_ms", obs_module_text("VBAN.out.prop.silence_hold_ms"), 100, 60000,
+			       100);
+
+	obs_properties_add_bool(props, "pacing", obs_module_text("VBAN.out.prop.pacing"));
+#ifdef __linux__
+	obs_properties_add_bool(props, "txtime", obs_module_text("VBAN.out.prop.txtime"));
+	obs_properties_add_bool(props, "batch", obs_module_text("VBAN.out.prop.batch"));
+#endif
 
 	return props;
 }
@@ -186,7 +586,16 @@ static void vban_out_get_defaults(obs_data_t *data)
 {
 	obs_data_set_default_int(data, "port", 6980);
 	obs_data_set_default_int(data, "mixer", 1);
+	obs_data_set_default_bool(data, "track1", true);
+	obs_data_set_default_int(data, "resampler_quality", VBAN_RESAMPLER_BALANCED);
 	obs_data_set_default_int(data, "format_bit", VBAN_BITFMT_24_INT);
+	obs_data_set_default_int(data, "codec", VBAN_OUT_CODEC_PCM);
+	obs_data_set_default_int(data, "opus_bitrate", 64);
+	obs_data_set_default_int(data, "samples_per_packet", 256);
+	obs_data_set_default_int(data, "latency_ms", 5);
+	obs_data_set_default_int(data, "max_queue_ms", 200);
+	obs_data_set_default_int(data, "queue_policy", VBAN_OUT_QUEUE_CATCH_UP);
+	obs_data_set_default_int(data, "silence_hold_ms", 2000);
 }
 
 static void *vban_out_create(obs_data_t *settings, obs_output_t *output)
@@ -196,7 +605,6 @@ static void *vban_out_create(obs_data_t *settings, obs_output_t *output)
 	v->context = output;
 
 	pthread_mutex_init(&v->mutex, NULL);
-	os_event_init(&v->event, OS_EVENT_TYPE_AUTO);
 
 	vban_out_update(v, settings);
 
@@ -208,26 +616,36 @@ static void vban_out_destroy(void *data)
 	blog(LOG_INFO, "vban_out_destroy destroying...");
 	struct vban_out_s *v = data;
 
-	while (v->buffer.size) {
-		struct audio_data pkt;
-		deque_pop_front(&v->buffer, &pkt, sizeof(pkt));
-		for (size_t i = 0; i < MAX_AV_PLANES; i++)
-			bfree(pkt.data[i]);
-	}
-
-	if (v->rt) {
-		resolve_thread_release(v->rt);
-		v->rt = NULL;
-	}
+	for (size_t i = 0; i < v->dests.num; i++)
+		dest_free(v->dests.array + i);
+	da_free(v->dests);
 
-	deque_free(&v->buffer);
+	destroy_tracks(v);
 	pthread_mutex_destroy(&v->mutex);
-	os_event_destroy(v->event);
 	bfree(v->stream_name);
 	bfree(v);
 	blog(LOG_INFO, "vban_out_destroy destroyed.");
 }
 
+static uint64_t vban_out_get_total_bytes(void *data)
+{
+	struct vban_out_s *v = data;
+	pthread_mutex_lock(&v->mutex);
+	uint64_t bytes = v->tx.cnt_bytes;
+	pthread_mutex_unlock(&v->mutex);
+	return bytes;
+}
+
+/* Reports the packets that could not be sent. */
+static int vban_out_get_dropped_frames(void *data)
+{
+	struct vban_out_s *v = data;
+	pthread_mutex_lock(&v->mutex);
+	uint64_t dropped = vban_send_stats_dropped(&v->tx);
+	pthread_mutex_unlock(&v->mutex);
+	return dropped < INT_MAX ? (int)dropped : INT_MAX;
+}
+
 #ifdef AUDIO_ONLY_WORKAROUND
 void vban_out_raw_video(void *data, struct video_data *frame)
 {
@@ -239,7 +657,7 @@ void vban_out_raw_video(void *data, struct video_data *frame)
 
 struct obs_output_info vban_output_info = {
 	.id = ID_PREFIX "output",
-	.flags = OBS_OUTPUT_AUDIO
+	.flags = OBS_OUTPUT_AUDIO | OBS_OUTPUT_MULTI_TRACK
 #ifdef AUDIO_ONLY_WORKAROUND
 		 | OBS_OUTPUT_VIDEO
 #endif
@@ -250,10 +668,13 @@ struct obs_output_info vban_output_info = {
 	.start = vban_out_start,
 	.stop = vban_out_stop,
 	.raw_audio = vban_out_raw_audio,
+	.raw_audio2 = vban_out_raw_audio2,
 #ifdef AUDIO_ONLY_WORKAROUND
 	.raw_video = vban_out_raw_video,
 #endif
 	.update = vban_out_update,
 	.get_defaults = vban_out_get_defaults,
 	.get_properties = vban_out_get_properties,
+	.get_total_bytes = vban_out_get_total_bytes,
+	.get_dropped_frames = vban_out_get_dropped_frames,
 };
@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <math.h>
+#include <obs-module.h>
+#include <util/darray.h>
+#include "plugin-macros.generated.h"
+#include "vban-resampler.h"
+
+/* Larger ratios, such as between rates of the 44.1 kHz and 8 kHz families, are left to libobs. */
+#define PHASES_MAX 1024
+#define TAPS_MAX 256
+
+struct step
+{
+	uint32_t phase;
+	uint32_t advance;
+};
+
+struct vban_resampler_s
+{
+	uint32_t rate_in;
+	uint32_t L; // interpolation factor
+	uint32_t M; // decimation factor
+	size_t channels;
+	size_t taps;
+	vban_dot_fn dot;
+
+	// `coef + phase * taps` holds the taps of each phase in reverse order.
+	float *coef;
+	struct step *steps;
+
+	// The input of each channel preceded by `taps - 1` older samples
+	DARRAY(float) work[MAX_AV_PLANES];
+	DARRAY(float) out[MAX_AV_PLANES];
+
+	// Position of the newest input sample for the next output, and its phase
+	size_t pos;
+	uint32_t phase;
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	for (int k = 1; k < 64 && term > sum * 1e-12; k++) {
+		double t = x / (2.0 * k);
+		term *= t * t;
+		sum += term;
+	}
+	return sum;
+}
+
+static void design_filter(struct vban_resampler_s *r, double rolloff, double beta)
+{
+	const size_t len = r->taps * r->L;
+	const double center = (double)(len - 1) / 2.0;
+	// Cutoff in cycles per sample at the interpolated rate
+	const double fc = 0.5 * rolloff / (double)(r->L > r->M ? r->L : r->M);
+	const double i0_beta = bessel_i0(beta);
+
+	r->coef = bmalloc(sizeof(float) * len);
+
+	for (uint32_t ph = 0; ph < r->L; ph++) {
+		float *c = r->coef + ph * r->taps;
+		double sum = 0.0;
+		for (size_t k = 0; k < r->taps; k++) {
+			double n = (double)(ph + k * r->L) - center;
+			double x = 2.0 * fc * n;
+			double sinc = fabs(x) < 1e-12 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+			double w = n / center;
+			double h = 2.0 * fc * sinc * bessel_i0(beta * sqrt(fmax(0.0, 1.0 - w * w))) / i0_beta;
+			// Tap `k` multiplies the input sample `k` before the newest one.
+			c[r->taps - 1 - k] = (float)h;
+			sum += h;
+		}
+
+		// Normalize each phase to the unity gain at DC so that no ripple appears at the rate of L.
+		for (size_t k = 0; k < r->taps && sum != 0.0; k++)
+			c[k] = (float)(c[k] / sum);
+	}
+}
+
+vban_resampler_t *vban_resampler_create(uint32_t rate_in, uint32_t rate_out, size_t channels,
+					enum vban_resampler_quality quality, vban_dot_fn dot)
+{
+	if (!rate_in || !rate_out || channels > MAX_AV_PLANES)
+		return NULL;
+
+	uint32_t g = gcd(rate_in, rate_out);
+	uint32_t L = rate_out / g;
+	uint32_t M = rate_in / g;
+	if (L > PHASES_MAX)
+		return NULL;
+
+	size_t taps;
+	double rolloff, beta;
+	switch (quality) {
+	case VBAN_RESAMPLER_LOW_LATENCY:
+		taps = 16;
+		rolloff = 0.85;
+		beta = 6.0;
+		break;
+	case VBAN_RESAMPLER_HIGH_QUALITY:
+		taps = 64;
+		rolloff = 0.95;
+		beta = 10.0;
+		break;
+	case VBAN_RESAMPLER_BALANCED:
+	default:
+		taps = 32;
+		rolloff = 0.91;
+		beta = 8.6;
+		break;
+	}
+
+	// When decimating, the filter has to be longer by the ratio to keep the same transition band.
+	if (M > L)
+		taps = (taps * M + L - 1) / L;
+	taps = (taps + 3) & ~(size_t)3;
+	if (taps > TAPS_MAX)
+		taps = TAPS_MAX;
+
+	vban_resampler_t *r = bzalloc(sizeof(struct vban_resampler_s));
+	r->rate_in = rate_in;
+	r->L = L;
+	r->M = M;
+	r->channels = channels;
+	r->taps = taps;
+	r->dot = dot;
+
+	design_filter(r, rolloff, beta);
+
+	r->steps = bmalloc(sizeof(struct step) * L);
+	for (uint32_t ph = 0; ph < L; ph++) {
+		r->steps[ph].phase = (ph + M) % L;
+		r->steps[ph].advance = (ph + M) / L;
+	}
+
+	for (size_t ch = 0; ch < channels; ch++) {
+		da_resize(r->work[ch], taps - 1);
+		memset(r->work[ch].array, 0, sizeof(float) * (taps - 1));
+	}
+	r->pos = taps - 1;
+
+	blog(LOG_INFO, "resampler: %u -> %u Hz, L=%u M=%u, %zu taps, delay %.3f ms", rate_in, rate_out, L, M, taps,
+	     (double)vban_resampler_delay_ns(r) * 1e-6);
+
+	return r;
+}
+
+void vban_resampler_destroy(vban_resampler_t *r)
+{
+	if (!r)
+		return;
+
+	for (size_t ch = 0; ch < MAX_AV_PLANES; ch++) {
+		da_free(r->work[ch]);
+		da_free(r->out[ch]);
+	}
+	bfree(r->coef);
+	bfree(r->steps);
+	bfree(r);
+}
+
+/* Returns the number of outputs and updates `*pos` and `*phase`. */
+static size_t process_channel(const vban_resampler_t *r, float *dst, const float *work, size_t work_len, size_t *pos,
+			      uint32_t *phase)
+{
+	const size_t taps = r->taps;
+	size_t p = *pos;
+	uint32_t ph = *phase;
+	size_t n = 0;
+
+	if (r->L == 1) {
+		// Integer decimation: one phase
+		for (; p < work_len; p += r->M)
+			dst[n++] = r->dot(r->coef, work + p + 1 - taps, taps);
+	}
+	else if (r->M == 1) {
+		// Integer interpolation: all phases for each input
+		for (; p < work_len; p++) {
+			for (; ph < r->L; ph++)
+				dst[n++] = r->dot(r->coef + ph * taps, work + p + 1 - taps, taps);
+			ph = 0;
+		}
+	}
+	else {
+		for (; p < work_len; n++) {
+			dst[n] = r->dot(r->coef + ph * taps, work + p + 1 - taps, taps);
+			const struct step *s = r->steps + ph;
+			p += s->advance;
+			ph = s->phase;
+		}
+	}
+
+	*pos = p;
+	*phase = ph;
+	return n;
+}
+
+uint32_t vban_resampler_process(vban_resampler_t *r, const float **out, const float *const *in, uint32_t frames)
+{
+	const size_t max_out = ((size_t)frames + 1) * r->L / r->M + 2;
+	size_t pos = r->pos;
+	uint32_t phase = r->phase;
+	size_t consumed = 0;
+	size_t n = 0;
+
+	for (size_t ch = 0; ch < r->channels; ch++) {
+		size_t work_len = r->work[ch].num;
+		da_resize(r->work[ch], work_len + frames);
+		memcpy(r->work[ch].array + work_len, in[ch], sizeof(float) * frames);
+		work_len += frames;
+
+		da_resize(r->out[ch], max_out);
+
+		// All channels start from the same state and end in the same state.
+		pos = r->pos;
+		phase = r->phase;
+		n = process_channel(r, r->out[ch].array, r->work[ch].array, work_len, &pos, &phase);
+		out[ch] = r->out[ch].array;
+
+		// Keep the samples needed by the next outputs.
+		consumed = pos + 1 - r->taps;
+		if (consumed > work_len)
+			consumed = work_len;
+		memmove(r->work[ch].array, r->work[ch].array + consumed, sizeof(float) * (work_len - consumed));
+		r->work[ch].num = work_len - consumed;
+	}
+
+	r->pos = pos - consumed;
+	r->phase = phase;
+
+	return (uint32_t)n;
+}
+
+uint64_t vban_resampler_delay_ns(const vban_resampler_t *r)
+{
+	// The filter of `taps * L` coefficients at the interpolated rate is symmetric.
+	uint64_t len = (uint64_t)r->taps * r->L;
+	return (len - 1) * 1000000000 / (2 * (uint64_t)r->L * r->rate_in);
+}
+
+size_t vban_resampler_taps(const vban_resampler_t *r)
+{
+	return r->taps;
+}
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vban-encode-simd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Polyphase resampler of planar float audio.
+ *
+ * The ratio of the sampling rates is reduced to L/M and the input is
+ * interpolated by L and decimated by M with a windowed-sinc filter split into
+ * L phases. The phase and the input advance for each output are taken from a
+ * table so that the inner loop is one inner product per output sample.
+ * The filter is linear-phase, so the delay is exactly known.
+ */
+
+typedef struct vban_resampler_s vban_resampler_t;
+
+enum vban_resampler_quality {
+	VBAN_RESAMPLER_LIBOBS = 0,
+	VBAN_RESAMPLER_LOW_LATENCY = 1,
+	VBAN_RESAMPLER_BALANCED = 2,
+	VBAN_RESAMPLER_HIGH_QUALITY = 3,
+};
+
+/**
+ * Create a resampler.
+ * @param[in] rate_in   Sampling rate of the input.
+ * @param[in] rate_out  Sampling rate of the output.
+ * @param[in] channels  Number of channels, up to `MAX_AV_PLANES`.
+ * @param[in] quality   Filter length preset, other than `VBAN_RESAMPLER_LIBOBS`.
+ * @param[in] dot       Kernel for the inner product.
+ * @return              The resampler, or NULL if the ratio cannot be reduced to a small number of phases.
+ */
+vban_resampler_t *vban_resampler_create(uint32_t rate_in, uint32_t rate_out, size_t channels,
+					enum vban_resampler_quality quality, vban_dot_fn dot);
+
+/**
+ * Destroy the resampler.
+ * @param[in] r  The resampler.
+ */
+void vban_resampler_destroy(vban_resampler_t *r);
+
+/**
+ * Resample audio.
+ * @param[in] r       The resampler.
+ * @param[out] out    Pointers to the output of each channel, valid until the next call.
+ * @param[in] in      Input of each channel.
+ * @param[in] frames  Number of input frames.
+ * @return            Number of output frames.
+ */
+uint32_t vban_resampler_process(vban_resampler_t *r, const float **out, const float *const *in, uint32_t frames);
+
+/**
+ * Get the group delay of the filter.
+ * @param[in] r  The resampler.
+ * @return       The delay in nanoseconds.
+ */
+uint64_t vban_resampler_delay_ns(const vban_resampler_t *r);
+
+/**
+ * Get the number of taps of each phase.
+ * @param[in] r  The resampler.
+ */
+size_t vban_resampler_taps(const vban_resampler_t *r);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
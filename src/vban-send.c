@@ -0,0 +1,661 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef __linux__
+#define _GNU_SOURCE // sendmmsg
+#endif
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include "plugin-macros.generated.h"
+#include "vban-send.h"
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+#ifdef __linux__
+#include <time.h>
+#include <netinet/udp.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif
+
+#if defined(__linux__) && defined(SO_TXTIME)
+#define HAVE_TXTIME
+#endif
+
+#if defined(__linux__) && defined(UDP_SEGMENT)
+#define HAVE_GSO
+/* Limit of the number of segments in the kernel */
+#define GSO_SEGMENTS_MAX 64
+/* All segments have to fit in one UDP datagram over IPv4. */
+#define GSO_BYTES_MAX 65507
+#endif
+
+#ifdef __linux__
+#define HAVE_SENDMMSG
+#endif
+
+/* Give up SO_TXTIME after the kernel reported this number of errors. */
+#define TXTIME_ERRORS_MAX 16
+
+bool vban_send_open(struct vban_send_s *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (!valid_socket(s->sock)) {
+		blog(LOG_ERROR, "vban-send: Failed to create socket");
+		return false;
+	}
+
+	s->gso = true;
+	s->open_ns = os_gettime_ns();
+
+	return true;
+}
+
+void vban_send_close(struct vban_send_s *s)
+{
+	if (s->cnt_syscalls) {
+		double sec = (double)(os_gettime_ns() - s->open_ns) * 1e-9;
+		blog(LOG_INFO, "vban-send: %" PRIu64 " packets in %" PRIu64 " system calls, %.1f calls/s",
+		     s->cnt_packets, s->cnt_syscalls, sec > 0.0 ? (double)s->cnt_syscalls / sec : 0.0);
+	}
+	if (s->cnt_would_block || s->cnt_retries)
+		blog(LOG_WARNING, "vban-send: the socket buffer was full %" PRIu64 " times after %" PRIu64 " waits",
+		     s->cnt_would_block, s->cnt_retries);
+	if (s->cnt_dropped)
+		blog(LOG_WARNING, "vban-send: %" PRIu64 " packets could not be sent", s->cnt_dropped);
+
+	if (valid_socket(s->sock))
+		closesocket(s->sock);
+	s->sock = INVALID_SOCKET;
+	s->txtime = false;
+	s->txtime_sock = false;
+	s->nonblock = false;
+	s->n_pkts = 0;
+	s->keep = false;
+	bfree(s->kept);
+	s->kept = NULL;
+}
+
+#ifdef HAVE_TXTIME
+/* Replaces the socket by a new one without SO_TXTIME. The old socket is kept if no socket can be created. */
+static void reopen_without_txtime(struct vban_send_s *s)
+{
+	socket_t sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (!valid_socket(sock)) {
+		blog(LOG_WARNING, "vban-send: Failed to create socket, SO_TXTIME stays set (errno=%d)", errno);
+		return;
+	}
+
+	closesocket(s->sock);
+	s->sock = sock;
+	s->txtime_sock = false;
+
+	bool nonblock = s->nonblock;
+	s->nonblock = false;
+	vban_send_set_nonblock(s, nonblock);
+}
+#endif
+
+bool vban_send_set_txtime(struct vban_send_s *s, bool enable)
+{
+	if (!valid_socket(s->sock) || s->txtime == enable || (enable && s->txtime_failed))
+		return s->txtime;
+
+#ifdef HAVE_TXTIME
+	if (!enable) {
+		s->txtime = false;
+		if (s->txtime_sock)
+			reopen_without_txtime(s);
+		return false;
+	}
+
+	struct sock_txtime cfg = {
+		.clockid = CLOCK_MONOTONIC,
+		.flags = SOF_TXTIME_REPORT_ERRORS,
+	};
+
+	if (!s->txtime_sock && setsockopt(s->sock, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)) < 0) {
+		blog(LOG_WARNING,
+		     "vban-send: SO_TXTIME is not available (errno=%d), falling back to pacing in userspace",
+		     errno);
+		s->txtime_failed = true;
+		return false;
+	}
+
+	s->txtime = true;
+	s->txtime_sock = true;
+	s->cnt_txtime_errors = 0;
+	return true;
+#else
+	if (enable) {
+		blog(LOG_WARNING, "vban-send: SO_TXTIME is not supported on this platform");
+		s->txtime_failed = true;
+	}
+	return false;
+#endif
+}
+
+bool vban_send_set_nonblock(struct vban_send_s *s, bool enable)
+{
+	if (!valid_socket(s->sock) || s->nonblock == enable)
+		return s->nonblock;
+
+#ifdef _WIN32
+	u_long mode = enable ? 1 : 0;
+	if (ioctlsocket(s->sock, FIONBIO, &mode) != 0) {
+		blog(LOG_WARNING, "vban-send: Failed to set non-blocking mode (error=%d)", WSAGetLastError());
+		return s->nonblock;
+	}
+#else
+	int flags = fcntl(s->sock, F_GETFL, 0);
+	if (flags < 0 || fcntl(s->sock, F_SETFL, enable ? flags | O_NONBLOCK : flags & ~O_NONBLOCK) < 0) {
+		blog(LOG_WARNING, "vban-send: Failed to set non-blocking mode (errno=%d)", errno);
+		return s->nonblock;
+	}
+#endif
+
+	s->nonblock = enable;
+	return s->nonblock;
+}
+
+void vban_send_set_retry(struct vban_send_s *s, int retry_max, int wait_ms)
+{
+	s->retry_max = retry_max;
+	s->retry_wait_ms = wait_ms;
+}
+
+void vban_send_set_keep(struct vban_send_s *s, bool enable)
+{
+	if (enable && !s->kept)
+		s->kept = bmalloc(VBAN_SEND_BATCH_MAX * sizeof(*s->kept));
+	s->keep = enable;
+}
+
+void vban_send_set_batch(struct vban_send_s *s, bool enable)
+{
+	if (s->batch && !enable)
+		vban_send_flush(s);
+	s->batch = enable;
+}
+
+void vban_send_commit(struct vban_send_s *s, const struct VBanHeader *header, const char *const payload[2],
+		      const size_t payload_len[2], const struct sockaddr_in *addr, uint64_t txtime_ns,
+		      struct vban_send_stats_s *stats)
+{
+	struct vban_send_pkt_s *pkt = s->pkts + s->n_pkts++;
+	memcpy(pkt->header, header, VBAN_HEADER_SIZE);
+	pkt->payload[0] = payload[0];
+	pkt->payload_len[0] = payload_len[0];
+	pkt->payload[1] = payload[1];
+	pkt->payload_len[1] = payload_len[1];
+	pkt->addr = *addr;
+	pkt->txtime_ns = txtime_ns;
+	pkt->stats = stats;
+	pkt->commit_ns = stats ? os_gettime_ns() : 0;
+	pkt->retries = 0;
+
+	if (!s->batch || s->n_pkts >= VBAN_SEND_BATCH_MAX)
+		vban_send_flush(s);
+}
+
+static inline size_t pkt_len(const struct vban_send_pkt_s *pkt)
+{
+	return VBAN_HEADER_SIZE + pkt->payload_len[0] + pkt->payload_len[1];
+}
+
+/* Classifies the error of the last call on the socket. */
+static enum vban_send_error last_error(int *err)
+{
+#ifdef _WIN32
+	int e = WSAGetLastError();
+	*err = e;
+	switch (e) {
+	case WSAEWOULDBLOCK:
+		return VBAN_SEND_ERR_WOULD_BLOCK;
+	case WSAENOBUFS:
+		return VBAN_SEND_ERR_NOBUFS;
+	case WSAENETUNREACH:
+	case WSAEHOSTUNREACH:
+	case WSAENETDOWN:
+	case WSAEHOSTDOWN:
+		return VBAN_SEND_ERR_UNREACHABLE;
+	case WSAECONNRESET: // ICMP port unreachable
+	case WSAECONNREFUSED:
+		return VBAN_SEND_ERR_REFUSED;
+	case WSAEMSGSIZE:
+		return VBAN_SEND_ERR_MSGSIZE;
+	default:
+		return VBAN_SEND_ERR_OTHER;
+	}
+#else
+	int e = errno;
+	*err = e;
+	if (e == EAGAIN || e == EWOULDBLOCK)
+		return VBAN_SEND_ERR_WOULD_BLOCK;
+	switch (e) {
+	case ENOBUFS:
+		return VBAN_SEND_ERR_NOBUFS;
+	case ENETUNREACH:
+	case EHOSTUNREACH:
+	case ENETDOWN:
+#ifdef EHOSTDOWN
+	case EHOSTDOWN:
+#endif
+		return VBAN_SEND_ERR_UNREACHABLE;
+	case ECONNREFUSED:
+		return VBAN_SEND_ERR_REFUSED;
+	case EMSGSIZE:
+		return VBAN_SEND_ERR_MSGSIZE;
+	default:
+		return VBAN_SEND_ERR_OTHER;
+	}
+#endif
+}
+
+static void count_sent(struct vban_send_s *s, size_t first, size_t n)
+{
+	uint64_t now = os_gettime_ns();
+	s->cnt_packets += n;
+	for (size_t i = first; i < first + n; i++) {
+		const struct vban_send_pkt_s *pkt = s->pkts + i;
+		struct vban_send_stats_s *st = pkt->stats;
+		if (!st)
+			continue;
+		uint64_t latency = now - pkt->commit_ns;
+		st->cnt_packets++;
+		st->cnt_bytes += pkt_len(pkt);
+		st->latency_sum_ns += latency;
+		if (latency > st->latency_max_ns)
+			st->latency_max_ns = latency;
+	}
+}
+
+static void count_dropped(struct vban_send_s *s, size_t first, size_t n, enum vban_send_error err, int e)
+{
+	s->cnt_dropped += n;
+	for (size_t i = first; i < first + n; i++) {
+		struct vban_send_stats_s *st = s->pkts[i].stats;
+		if (!st)
+			continue;
+		st->cnt_errors[err]++;
+		st->last_error = err;
+		st->last_errno = e;
+	}
+}
+
+/* Called after sending `n` packets from `first` failed.
+ * Returns true if the socket buffer is full in non-blocking mode, which leaves the packets to the retry policy.
+ * Otherwise the packets are dropped. */
+static bool send_failed(struct vban_send_s *s, size_t first, size_t n)
+{
+	int e;
+	enum vban_send_error err = last_error(&e);
+	if (s->nonblock && err == VBAN_SEND_ERR_WOULD_BLOCK) {
+		s->blocked = true;
+		return true;
+	}
+
+	count_dropped(s, first, n, err, e);
+	return false;
+}
+
+/* Waits until the socket buffer has space. Returns false on timeout. */
+static bool wait_writable(struct vban_send_s *s)
+{
+#ifdef _WIN32
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(s->sock, &fds);
+	struct timeval tv = {.tv_sec = 0, .tv_usec = s->retry_wait_ms * 1000};
+	return select(0, NULL, &fds, NULL, &tv) > 0;
+#else
+	struct pollfd pfd = {.fd = s->sock, .events = POLLOUT};
+	return poll(&pfd, 1, s->retry_wait_ms) > 0;
+#endif
+}
+
+bool vban_send_wait(struct vban_send_s *s)
+{
+	if (!wait_writable(s))
+		return false;
+	s->cnt_retries++;
+	return true;
+}
+
+/* Moves the packets from `first` to the head of the queue for the next flush, with their payloads copied.
+ * A packet that has already been kept `retry_max` times is dropped, and so are the oldest ones that would fill
+ * the queue. Returns the number of the kept packets. */
+static size_t keep_unsent(struct vban_send_s *s, size_t first)
+{
+	size_t n = 0;
+	for (size_t i = first; i < s->n_pkts; i++) {
+		struct vban_send_pkt_s *pkt = s->pkts + i;
+		if (pkt->retries++ >= s->retry_max || s->n_pkts - i >= VBAN_SEND_BATCH_MAX) {
+			count_dropped(s, i, 1, VBAN_SEND_ERR_WOULD_BLOCK, 0);
+			continue;
+		}
+
+		// A payload kept before is in the slot of its index, which is not before the slot `n`.
+		char *dst = s->kept[n];
+		memmove(dst, pkt->payload[0], pkt->payload_len[0]);
+		if (pkt->payload_len[1])
+			memcpy(dst + pkt->payload_len[0], pkt->payload[1], pkt->payload_len[1]);
+		pkt->payload[0] = dst;
+		pkt->payload_len[0] += pkt->payload_len[1];
+		pkt->payload[1] = NULL;
+		pkt->payload_len[1] = 0;
+
+		if (n != i)
+			s->pkts[n] = *pkt;
+		n++;
+	}
+	return n;
+}
+
+/* Maximum number of iovecs of a packet: the header and two segments of the payload */
+#define PKT_IOV_MAX 3
+
+#ifndef _WIN32
+/* Returns the number of iovecs filled. */
+static inline size_t pkt_iov(struct vban_send_pkt_s *pkt, struct iovec *iov)
+{
+	size_t n = 0;
+	iov[n].iov_base = pkt->header;
+	iov[n++].iov_len = VBAN_HEADER_SIZE;
+	for (size_t i = 0; i < 2; i++) {
+		if (!pkt->payload_len[i])
+			continue;
+		iov[n].iov_base = (void *)pkt->payload[i];
+		iov[n++].iov_len = pkt->payload_len[i];
+	}
+	return n;
+}
+#endif
+
+static size_t send_one(struct vban_send_s *s, size_t i)
+{
+	struct vban_send_pkt_s *pkt = s->pkts + i;
+	s->cnt_syscalls++;
+
+#ifndef _WIN32
+	struct iovec iov[PKT_IOV_MAX];
+	struct msghdr msg = {
+		.msg_name = &pkt->addr,
+		.msg_namelen = sizeof(pkt->addr),
+		.msg_iov = iov,
+		.msg_iovlen = pkt_iov(pkt, iov),
+	};
+	if (sendmsg(s->sock, &msg, 0) < 0)
+		return send_failed(s, i, 1) ? 0 : 1;
+#else
+	char buf[VBAN_PROTOCOL_MAX_SIZE];
+	memcpy(buf, pkt->header, VBAN_HEADER_SIZE);
+	memcpy(buf + VBAN_HEADER_SIZE, pkt->payload[0], pkt->payload_len[0]);
+	memcpy(buf + VBAN_HEADER_SIZE + pkt->payload_len[0], pkt->payload[1], pkt->payload_len[1]);
+	if (sendto(s->sock, buf, pkt_len(pkt), 0, (const struct sockaddr *)&pkt->addr, (socklen_t)sizeof(pkt->addr)) <
+	    0)
+		return send_failed(s, i, 1) ? 0 : 1;
+#endif
+	count_sent(s, i, 1);
+	return 1;
+}
+
+#ifdef HAVE_TXTIME
+static void drain_txtime_errors(struct vban_send_s *s)
+{
+	for (int i = 0; i < 16; i++) {
+		char ctrl[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+		char data[64];
+		struct iovec iov = {.iov_base = data, .iov_len = sizeof(data)};
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = ctrl,
+			.msg_controllen = sizeof(ctrl),
+		};
+
+		if (recvmsg(s->sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR)
+				continue;
+			const struct sock_extended_err *ee = (const void *)CMSG_DATA(cm);
+			if (ee->ee_origin == SO_EE_ORIGIN_TXTIME)
+				s->cnt_txtime_errors++;
+		}
+	}
+
+	if (s->cnt_txtime_errors >= TXTIME_ERRORS_MAX) {
+		blog(LOG_WARNING, "vban-send: qdisc reported %" PRIu64 " errors, falling back to pacing in userspace",
+		     s->cnt_txtime_errors);
+		s->txtime_failed = true;
+		vban_send_set_txtime(s, false);
+	}
+}
+#endif
+
+#ifdef HAVE_GSO
+static inline bool same_addr(const struct sockaddr_in *a, const struct sockaddr_in *b)
+{
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/* Number of packets from `first` that can be sent as one GSO packet.
+ * All segments need the same size except the last one, which can be shorter. */
+static size_t gso_run_length(const struct vban_send_s *s, size_t first)
+{
+	const struct vban_send_pkt_s *p0 = s->pkts + first;
+	size_t n = 1;
+	size_t bytes = pkt_len(p0);
+	while (first + n < s->n_pkts && n < GSO_SEGMENTS_MAX) {
+		const struct vban_send_pkt_s *p = s->pkts + first + n;
+		if (!same_addr(&p->addr, &p0->addr) || pkt_len(p) > pkt_len(p0) || bytes + pkt_len(p) > GSO_BYTES_MAX)
+			break;
+		n++;
+		bytes += pkt_len(p);
+		if (pkt_len(p) < pkt_len(p0))
+			break;
+	}
+	return n;
+}
+
+static size_t send_gso(struct vban_send_s *s, size_t first, size_t n)
+{
+	struct iovec iov[VBAN_SEND_BATCH_MAX * PKT_IOV_MAX];
+	size_t n_iov = 0;
+	for (size_t i = 0; i < n; i++)
+		n_iov += pkt_iov(s->pkts + first + i, iov + n_iov);
+
+	char ctrl[CMSG_SPACE(sizeof(uint16_t))] = {0};
+	struct msghdr msg = {
+		.msg_name = &s->pkts[first].addr,
+		.msg_namelen = sizeof(struct sockaddr_in),
+		.msg_iov = iov,
+		.msg_iovlen = n_iov,
+		.msg_control = ctrl,
+		.msg_controllen = sizeof(ctrl),
+	};
+
+	uint16_t gso_size = (uint16_t)pkt_len(s->pkts + first);
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_UDP;
+	cm->cmsg_type = UDP_SEGMENT;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+
+	s->cnt_syscalls++;
+	if (sendmsg(s->sock, &msg, 0) < 0) {
+		if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+			blog(LOG_WARNING, "vban-send: UDP GSO is not available (errno=%d), using sendmmsg", errno);
+			s->gso = false;
+			return 0;
+		}
+		return send_failed(s, first, n) ? 0 : n;
+	}
+
+	count_sent(s, first, n);
+	return n;
+}
+#endif
+
+#ifdef HAVE_SENDMMSG
+static size_t send_mmsg(struct vban_send_s *s, size_t first)
+{
+	size_t n = s->n_pkts - first;
+	struct mmsghdr msgs[VBAN_SEND_BATCH_MAX];
+	struct iovec iov[VBAN_SEND_BATCH_MAX * PKT_IOV_MAX];
+	size_t n_iov = 0;
+	char ctrl[VBAN_SEND_BATCH_MAX][CMSG_SPACE(sizeof(uint64_t))];
+
+	memset(msgs, 0, sizeof(struct mmsghdr) * n);
+	for (size_t i = 0; i < n; i++) {
+		struct vban_send_pkt_s *pkt = s->pkts + first + i;
+		struct msghdr *msg = &msgs[i].msg_hdr;
+		msg->msg_name = &pkt->addr;
+		msg->msg_namelen = sizeof(pkt->addr);
+		msg->msg_iov = iov + n_iov;
+		msg->msg_iovlen = pkt_iov(pkt, iov + n_iov);
+		n_iov += msg->msg_iovlen;
+
+#ifdef HAVE_TXTIME
+		if (s->txtime) {
+			memset(ctrl[i], 0, sizeof(ctrl[i]));
+			msg->msg_control = ctrl[i];
+			msg->msg_controllen = sizeof(ctrl[i]);
+			struct cmsghdr *cm = CMSG_FIRSTHDR(msg);
+			cm->cmsg_level = SOL_SOCKET;
+			cm->cmsg_type = SCM_TXTIME;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+			memcpy(CMSG_DATA(cm), &pkt->txtime_ns, sizeof(uint64_t));
+		}
+#endif
+	}
+
+	s->cnt_syscalls++;
+	int ret = sendmmsg(s->sock, msgs, (unsigned int)n, 0);
+	if (ret < 0) {
+#ifdef HAVE_TXTIME
+		if (s->txtime && (errno == EINVAL || errno == EOPNOTSUPP)) {
+			blog(LOG_WARNING,
+			     "vban-send: sendmmsg with SCM_TXTIME failed (errno=%d),"
+			     " falling back to pacing in userspace",
+			     errno);
+			s->txtime_failed = true;
+			vban_send_set_txtime(s, false);
+			return 0;
+		}
+#endif
+		// The first packet could not be sent. Drop it and continue.
+		return send_failed(s, first, 1) ? 0 : 1;
+	}
+	if (ret == 0) {
+		count_dropped(s, first, 1, VBAN_SEND_ERR_OTHER, 0);
+		return 1;
+	}
+
+	count_sent(s, first, (size_t)ret);
+	return (size_t)ret;
+}
+#endif
+
+size_t vban_send_flush(struct vban_send_s *s)
+{
+	size_t i = 0;
+	int retries = 0;
+	s->blocked = false;
+
+	while (i < s->n_pkts) {
+		size_t n = 0;
+
+#ifdef HAVE_GSO
+		if (s->gso && !s->txtime) {
+			size_t n_gso = gso_run_length(s, i);
+			if (n_gso > 1)
+				n = send_gso(s, i, n_gso);
+		}
+#endif
+
+#ifdef HAVE_SENDMMSG
+		if (!n && !s->blocked && (s->txtime || s->n_pkts - i > 1))
+			n = send_mmsg(s, i);
+#endif
+
+		// Fall back to a single packet if the path above was just disabled.
+		if (!n && !s->blocked)
+			n = send_one(s, i);
+
+		if (s->blocked) {
+			if (s->keep || retries >= s->retry_max || !wait_writable(s))
+				break;
+			retries++;
+			s->cnt_retries++;
+			s->blocked = false;
+		}
+
+		i += n;
+	}
+
+	size_t n_kept = 0;
+	if (s->blocked) {
+		s->cnt_would_block++;
+		if (s->keep)
+			n_kept = keep_unsent(s, i);
+		else
+			count_dropped(s, i, s->n_pkts - i, VBAN_SEND_ERR_WOULD_BLOCK, 0);
+	}
+
+#ifdef HAVE_TXTIME
+	if (s->txtime)
+		drain_txtime_errors(s);
+#endif
+
+	size_t n_pkts = s->n_pkts - n_kept;
+	s->n_pkts = n_kept;
+	return n_pkts;
+}
+
+void vban_send_stats_add(struct vban_send_stats_s *dst, const struct vban_send_stats_s *src)
+{
+	dst->cnt_packets += src->cnt_packets;
+	dst->cnt_bytes += src->cnt_bytes;
+	for (int i = 0; i < VBAN_SEND_ERR_MAX; i++)
+		dst->cnt_errors[i] += src->cnt_errors[i];
+	if (vban_send_stats_dropped(src)) {
+		dst->last_error = src->last_error;
+		dst->last_errno = src->last_errno;
+	}
+	dst->latency_sum_ns += src->latency_sum_ns;
+	if (src->latency_max_ns > dst->latency_max_ns)
+		dst->latency_max_ns = src->latency_max_ns;
+}
+
+uint64_t vban_send_stats_dropped(const struct vban_send_stats_s *st)
+{
+	uint64_t n = 0;
+	for (int i = 0; i < VBAN_SEND_ERR_MAX; i++)
+		n += st->cnt_errors[i];
+	return n;
+}
+
+const char *vban_send_error_name(enum vban_send_error err)
+{
+	switch (err) {
+	case VBAN_SEND_ERR_WOULD_BLOCK:
+		return "socket buffer full";
+	case VBAN_SEND_ERR_NOBUFS:
+		return "no buffer space";
+	case VBAN_SEND_ERR_UNREACHABLE:
+		return "unreachable";
+	case VBAN_SEND_ERR_REFUSED:
+		return "refused";
+	case VBAN_SEND_ERR_MSGSIZE:
+		return "too long";
+	default:
+		return "other";
+	}
+}
@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "socket.h"
+#include "vban.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of packets submitted by one system call. */
+#define VBAN_SEND_BATCH_MAX 64
+
+/* Causes of the packets that could not be sent */
+enum vban_send_error
+{
+	VBAN_SEND_ERR_WOULD_BLOCK = 0, // the socket buffer stayed full in non-blocking mode
+	VBAN_SEND_ERR_NOBUFS,          // no buffer space in the kernel or in the queue of the interface
+	VBAN_SEND_ERR_UNREACHABLE,     // no route, or the network or the host is down
+	VBAN_SEND_ERR_REFUSED,         // the destination refused an earlier packet
+	VBAN_SEND_ERR_MSGSIZE,         // too long for the path
+	VBAN_SEND_ERR_OTHER,
+	VBAN_SEND_ERR_MAX,
+};
+
+/* Counters of the packets of one owner, updated when the packets are flushed */
+struct vban_send_stats_s
+{
+	uint64_t cnt_packets;
+	uint64_t cnt_bytes;
+	uint64_t cnt_errors[VBAN_SEND_ERR_MAX];
+	int last_error; // enum vban_send_error of the last packet that could not be sent
+	int last_errno;
+
+	// time from the commit until the packet is given to the kernel
+	uint64_t latency_sum_ns;
+	uint64_t latency_max_ns;
+};
+
+struct vban_send_pkt_s
+{
+	char header[VBAN_HEADER_SIZE];
+	const char *payload[2];
+	size_t payload_len[2];
+	struct sockaddr_in addr;
+	uint64_t txtime_ns;
+	struct vban_send_stats_s *stats;
+	uint64_t commit_ns;
+	int retries; // flushes that found the socket buffer full
+};
+
+/**
+ * Socket used to transmit VBAN packets.
+ *
+ * A packet is queued by `vban_send_commit` with a header for each destination
+ * and submitted by `vban_send_flush`. The payload is not copied; it is given
+ * to the socket as one or two iovecs following the header.
+ * Unless batching is enabled, each commit is flushed immediately.
+ * The result of each packet is counted to the statistics given at the commit.
+ */
+struct vban_send_s
+{
+	socket_t sock;
+
+	/* True if the packets carry their departure time for the kernel. */
+	bool txtime;
+	/* True if SO_TXTIME is set on the socket, which the kernel keeps until the socket is closed. */
+	bool txtime_sock;
+	/* True once SO_TXTIME failed or the qdisc reported too many errors; it is not tried again. */
+	bool txtime_failed;
+	uint64_t cnt_txtime_errors;
+
+	/* True if committed packets are held until `vban_send_flush`. */
+	bool batch;
+	/* False once the kernel rejected UDP_SEGMENT. */
+	bool gso;
+	/* True if sending returns instead of waiting for space in the socket buffer. */
+	bool nonblock;
+	/* Set by `vban_send_flush` if the socket buffer was full and the remaining packets were dropped. */
+	bool blocked;
+	/* In non-blocking mode, how many times one flush waits for space in the socket buffer before dropping. */
+	int retry_max;
+	int retry_wait_ms;
+	/* True if a flush keeps the packets that do not fit the socket buffer for the next flush instead of waiting.
+	 * Their payloads are copied into `kept`, `VBAN_SEND_BATCH_MAX` slots, so that the owners may change them. */
+	bool keep;
+	char (*kept)[VBAN_DATA_MAX_SIZE];
+
+	struct vban_send_pkt_s pkts[VBAN_SEND_BATCH_MAX];
+	size_t n_pkts;
+
+	// statistics
+	uint64_t open_ns;
+	uint64_t cnt_packets;
+	uint64_t cnt_syscalls;
+	uint64_t cnt_would_block;
+	uint64_t cnt_retries;
+	uint64_t cnt_dropped;
+};
+
+/**
+ * Open the socket.
+ * @param[out] s  The sender.
+ * @return        True if succeeded.
+ */
+bool vban_send_open(struct vban_send_s *s);
+
+/**
+ * Close the socket. Pending packets are discarded.
+ * @param[in] s  The sender.
+ */
+void vban_send_close(struct vban_send_s *s);
+
+/**
+ * Enable or disable the departure time scheduled by the kernel.
+ * @param[in] s       The sender.
+ * @param[in] enable  True to enable.
+ * @return            The new state. False if SO_TXTIME is not available or has failed before.
+ *
+ * The departure time is given in the same clock as `os_gettime_ns`.
+ * On Linux, the `fq` qdisc has to be configured on the egress interface.
+ * SO_TXTIME cannot be cleared from a socket, so disabling replaces the socket by a new one.
+ * Queued packets are kept and sent by the new socket.
+ */
+bool vban_send_set_txtime(struct vban_send_s *s, bool enable);
+
+/**
+ * Enable or disable batching. Pending packets are flushed when disabling.
+ * @param[in] s       The sender.
+ * @param[in] enable  True to enable.
+ */
+void vban_send_set_batch(struct vban_send_s *s, bool enable);
+
+/**
+ * Enable or disable the non-blocking mode of the socket.
+ * @param[in] s       The sender.
+ * @param[in] enable  True to enable.
+ * @return            The new state.
+ */
+bool vban_send_set_nonblock(struct vban_send_s *s, bool enable);
+
+/**
+ * Set how long a flush waits for the socket buffer in non-blocking mode.
+ * @param[in] s          The sender.
+ * @param[in] retry_max  Number of waits in one flush, 0 to drop the packets at once.
+ * @param[in] wait_ms    Longest time of each wait in milliseconds.
+ */
+void vban_send_set_retry(struct vban_send_s *s, int retry_max, int wait_ms);
+
+/**
+ * Enable or disable keeping the packets that do not fit the socket buffer in non-blocking mode.
+ * @param[in] s       The sender.
+ * @param[in] enable  True to enable.
+ *
+ * While enabled, a flush does not wait for the socket buffer. The remaining packets are kept
+ * in the queue with their payloads copied and are sent by the next flush, which the caller can
+ * do after `vban_send_wait`. A packet is dropped once `retry_max` flushes could not send it.
+ * The statistics given at the commit still have to stay valid until the packet is sent or dropped.
+ */
+void vban_send_set_keep(struct vban_send_s *s, bool enable);
+
+/**
+ * Wait until the socket buffer has space.
+ * @param[in] s  The sender.
+ * @return       False if the buffer stayed full for `retry_wait_ms`.
+ */
+bool vban_send_wait(struct vban_send_s *s);
+
+/**
+ * Queue a packet.
+ * @param[in] s            The sender.
+ * @param[in] header       The header, which is copied.
+ * @param[in] payload      The first and the second segments of the payload, which are not copied.
+ * @param[in] payload_len  Lengths of the segments in bytes. The second length can be 0.
+ * @param[in] addr         The destination.
+ * @param[in] txtime_ns    The departure time if SO_TXTIME is enabled.
+ * @param[in] stats        Statistics to count the packet to, or NULL.
+ *
+ * The payload and the statistics have to stay valid until the packet is flushed.
+ */
+void vban_send_commit(struct vban_send_s *s, const struct VBanHeader *header, const char *const payload[2],
+		      const size_t payload_len[2], const struct sockaddr_in *addr, uint64_t txtime_ns,
+		      struct vban_send_stats_s *stats);
+
+/**
+ * Submit all queued packets.
+ * @param[in] s  The sender.
+ * @return       Number of packets sent.
+ *
+ * Consecutive packets of the same size to the same destination are sent as one
+ * UDP GSO packet if SO_TXTIME is disabled. Otherwise, `sendmmsg` is used on Linux.
+ * In non-blocking mode, the flush waits for the socket buffer up to the retry policy,
+ * then the packets are dropped from the first one that does not fit and `blocked` is set.
+ * If keeping is enabled, the flush does not wait and those packets stay in the queue instead.
+ */
+size_t vban_send_flush(struct vban_send_s *s);
+
+/**
+ * Add the statistics to another.
+ * @param[in,out] dst  The sum.
+ * @param[in] src      The statistics to add.
+ */
+void vban_send_stats_add(struct vban_send_stats_s *dst, const struct vban_send_stats_s *src);
+
+/**
+ * Get the number of packets that could not be sent.
+ * @param[in] st  The statistics.
+ * @return        Sum of the errors of all causes.
+ */
+uint64_t vban_send_stats_dropped(const struct vban_send_stats_s *st);
+
+/**
+ * Get the name of a cause of errors for the log.
+ * @param[in] err  The cause.
+ * @return         The name.
+ */
+const char *vban_send_error_name(enum vban_send_error err);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
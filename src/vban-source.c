@@ -20,6 +20,9 @@
 #include <util/platform.h>
 #include "plugin-macros.generated.h"
 #include "vban-udp.h"
+#include "vban-fec.h"
+#include "vban-opus.h"
+#include "vban-encode.h"
 #include "vban.h"
 
 struct vban_src_s
@@ -32,8 +35,13 @@ struct vban_src_s
 	char *ip_from;
 
 	vban_udp_t *vban;
+	vban_fec_dec_t *fec; // created when the first parity packet arrives
+	vban_opus_dec_t *opus;
+	int opus_rate;
+	size_t opus_channels;
 
 	DARRAY(float) buffer;
+	DARRAY(int16_t) unpacked;
 	uint32_t lastframe;
 	uint32_t cnt_missing_packets;
 	uint64_t cnt_packets;
@@ -143,9 +151,19 @@ static void vban_src_destroy(void *data)
 	     "source '%s': received %" PRIu64 " packets, %" PRIu64 " frames, %d time(s) missed packets",
 	     obs_source_get_name(s->context), s->cnt_packets, s->cnt_frames, s->cnt_missing_packets);
 
+	if (s->fec) {
+		uint64_t recovered, unrecoverable;
+		vban_fec_dec_stats(s->fec, &recovered, &unrecoverable);
+		blog(LOG_INFO, "source '%s': %" PRIu64 " packets reconstructed from parity, %" PRIu64 " unrecoverable",
+		     obs_source_get_name(s->context), recovered, unrecoverable);
+		vban_fec_dec_destroy(s->fec);
+	}
+	vban_opus_dec_destroy(s->opus);
+
 	bfree(s->stream_name);
 	bfree(s->ip_from);
 	da_free(s->buffer);
+	da_free(s->unpacked);
 	bfree(s);
 }
 
@@ -178,7 +196,7 @@ static void convert_24le_to_fltp(struct vban_src_s *s, struct obs_source_audio *
 	}
 }
 
-static void vban_src_callback(const char *buf, size_t buf_len, void *data)
+static void vban_src_output(void *data, const char *buf, size_t buf_len, uint64_t timestamp)
 {
 	struct vban_src_s *s = data;
 
@@ -197,12 +215,9 @@ static void vban_src_callback(const char *buf, size_t buf_len, void *data)
 		.samples_per_sec = VBanSRList[header->format_SR & VBAN_SR_MASK],
 	};
 
-	size_t len_exp =
-		VBanBitResolutionSize[header->format_bit & VBAN_BIT_RESOLUTION_MASK] * audio.frames * audio.speakers;
+	size_t len_exp = vban_payload_size(header->format_bit, (size_t)audio.frames * audio.speakers);
 	if (payload_len < len_exp) {
-		blog(LOG_ERROR, "Too small payload size %d, expected %d", (int)payload_len,
-		     VBanBitResolutionSize[header->format_bit & VBAN_BIT_RESOLUTION_MASK] * audio.frames *
-			     (int)audio.speakers);
+		blog(LOG_ERROR, "Too small payload size %d, expected %d", (int)payload_len, (int)len_exp);
 		return;
 	}
 
@@ -219,6 +234,13 @@ static void vban_src_callback(const char *buf, size_t buf_len, void *data)
 		audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
 		convert_24le_to_fltp(s, &audio, payload);
 		break;
+	case VBAN_BITFMT_12_INT:
+	case VBAN_BITFMT_10_INT:
+		da_resize(s->unpacked, (size_t)audio.frames * audio.speakers);
+		vban_decode_unpack(header->format_bit, s->unpacked.array, payload, s->unpacked.num);
+		audio.format = AUDIO_FORMAT_16BIT;
+		audio.data[0] = (const uint8_t *)s->unpacked.array;
+		break;
 	case VBAN_BITFMT_32_INT:
 		audio.format = AUDIO_FORMAT_32BIT;
 		audio.data[0] = (const uint8_t *)payload;
@@ -232,7 +254,7 @@ static void vban_src_callback(const char *buf, size_t buf_len, void *data)
 		return;
 	}
 
-	audio.timestamp = os_gettime_ns() - (uint64_t)audio.frames * 1000000000 / audio.samples_per_sec;
+	audio.timestamp = timestamp;
 
 	if (s->cnt_packets > 0 && s->lastframe + 1 != header->nuFrame) {
 		uint32_t n_packets = header->nuFrame - s->lastframe - 1;
@@ -259,3 +281,96 @@ static void vban_src_callback(const char *buf, size_t buf_len, void *data)
 
 	obs_source_output_audio(s->context, &audio);
 }
+
+/* Decodes an Opus packet. Lost packets are concealed by the decoder instead of repeating the audio. */
+static void vban_src_output_opus(struct vban_src_s *s, const char *buf, size_t buf_len, uint64_t timestamp)
+{
+	const struct VBanHeader *header = (const struct VBanHeader *)buf;
+	const int rate = VBanSRList[header->format_SR & VBAN_SR_MASK];
+	const size_t channels = (size_t)header->format_nbc + 1;
+
+	if (channels > 8) {
+		blog(LOG_ERROR, "Too many number of channels: %d", (int)channels);
+		return;
+	}
+
+	if (rate != s->opus_rate || channels != s->opus_channels) {
+		vban_opus_dec_destroy(s->opus);
+		s->opus = vban_opus_rate_supported(rate) ? vban_opus_dec_create(rate, channels) : NULL;
+		s->opus_rate = rate;
+		s->opus_channels = channels;
+		if (!s->opus)
+			blog(LOG_ERROR, "source '%s': cannot decode Opus of %d channels at %d Hz",
+			     obs_source_get_name(s->context), (int)channels, rate);
+	}
+	if (!s->opus)
+		return;
+
+	struct obs_source_audio audio = {
+		.frames = header->format_nbs + 1,
+		.speakers = (enum speaker_layout)channels,
+		.samples_per_sec = rate,
+		.format = AUDIO_FORMAT_FLOAT,
+	};
+	da_resize(s->buffer, channels * audio.frames);
+	audio.data[0] = (const uint8_t *)s->buffer.array;
+
+	if (s->cnt_packets > 0 && s->lastframe + 1 != header->nuFrame) {
+		uint32_t n_packets = header->nuFrame - s->lastframe - 1;
+		blog(LOG_ERROR, "source '%s': missing %d packet(s) at frame %u", obs_source_get_name(s->context),
+		     n_packets, header->nuFrame);
+		s->cnt_missing_packets++;
+
+		uint64_t lost_ns = (uint64_t)n_packets * audio.frames * 1000000000 / audio.samples_per_sec;
+
+		if (lost_ns < 70 * 1000000) {
+			for (uint32_t i = 0; i < n_packets; i++) {
+				if (!vban_opus_dec_decode(s->opus, NULL, 0, audio.frames, s->buffer.array))
+					break;
+				audio.timestamp = timestamp - lost_ns * (n_packets - i) / n_packets;
+				obs_source_output_audio(s->context, &audio);
+			}
+		}
+	}
+	s->lastframe = header->nuFrame;
+
+	if (!vban_opus_dec_decode(s->opus, buf, buf_len, audio.frames, s->buffer.array))
+		return;
+
+	s->cnt_packets++;
+	s->cnt_frames += audio.frames;
+
+	audio.timestamp = timestamp;
+	obs_source_output_audio(s->context, &audio);
+}
+
+static void vban_src_callback(const char *buf, size_t buf_len, void *data)
+{
+	struct vban_src_s *s = data;
+	const struct VBanHeader *header = (const struct VBanHeader *)buf;
+
+	// Packets held for the parity keep the time they arrived.
+	uint64_t timestamp = os_gettime_ns() - ((uint64_t)header->format_nbs + 1) * 1000000000 /
+						       VBanSRList[header->format_SR & VBAN_SR_MASK];
+
+	if ((header->format_bit & VBAN_CODEC_MASK) == VBAN_CODEC_USER) {
+		// Opus frames are not protected by the parity.
+		if (vban_opus_is_packet(buf, buf_len)) {
+			vban_src_output_opus(s, buf, buf_len, timestamp);
+			return;
+		}
+		if (!vban_fec_is_parity(buf, buf_len))
+			return;
+		if (!s->fec) {
+			blog(LOG_INFO, "source '%s': receiving parity packets", obs_source_get_name(s->context));
+			s->fec = vban_fec_dec_create(vban_src_output, s);
+		}
+		vban_fec_dec_parity(s->fec, buf, buf_len);
+		return;
+	}
+
+	if (s->fec)
+		vban_fec_dec_audio(s->fec, buf, buf_len, timestamp);
+	else
+		vban_src_output(s, buf, buf_len, timestamp);
+}
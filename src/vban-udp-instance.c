@@ -143,6 +143,8 @@ void vban_udp_add_callback(vban_udp_t *dev, vban_udp_cb_t cb, void *data)
 
 void vban_udp_remove_callback(vban_udp_t *dev, vban_udp_cb_t cb, void *data)
 {
+	resolve_cache_t *host = NULL;
+
 	pthread_mutex_lock(&dev->mutex);
 
 	for (struct source_list_s *item = dev->sources; item; item = item->next) {
@@ -154,11 +156,15 @@ void vban_udp_remove_callback(vban_udp_t *dev, vban_udp_cb_t cb, void *data)
 		*item->prev_next = item->next;
 		if (item->next)
 			item->next->prev_next = item->prev_next;
+		host = item->host;
 		bfree(item);
 		break;
 	}
 
 	pthread_mutex_unlock(&dev->mutex);
+
+	if (host)
+		resolve_cache_release(host);
 }
 
 static void copy_stream_name(char *dst, const char *src)
@@ -190,33 +196,10 @@ void vban_udp_set_name(vban_udp_t *dev, vban_udp_cb_t cb, void *data, const char
 }
 
 static void vban_udp_set_addr_mask(vban_udp_t *dev, vban_udp_cb_t cb, void *data, const struct in_addr *addr,
-				   const struct in_addr *mask)
+				   const struct in_addr *mask, resolve_cache_t *host)
 {
-	pthread_mutex_lock(&dev->mutex);
+	resolve_cache_t *old_host = NULL;
 
-	for (struct source_list_s *item = dev->sources; item; item = item->next) {
-		if (item->cb != cb)
-			continue;
-		if (item->data != data)
-			continue;
-
-		item->addr = *addr;
-		item->mask = *mask;
-		item->resolving = NULL;
-		break;
-	}
-
-	pthread_mutex_unlock(&dev->mutex);
-}
-
-struct vban_udp_set_host_thread_s
-{
-	vban_udp_t *dev;
-};
-
-static inline void mark_resolving(vban_udp_t *dev, vban_udp_cb_t cb, void *data,
-				  struct vban_udp_set_host_thread_s *resolving)
-{
 	pthread_mutex_lock(&dev->mutex);
 
 	for (struct source_list_s *item = dev->sources; item; item = item->next) {
@@ -225,50 +208,23 @@ static inline void mark_resolving(vban_udp_t *dev, vban_udp_cb_t cb, void *data,
 		if (item->data != data)
 			continue;
 
-		/* If there is an earlier resolving thread, the result from the
-		 * earlier thread will be ignored even if the earlier thread
-		 * takes more time than the later resolving thread(s). */
-		item->resolving = resolving;
-		break;
-	}
-
-	pthread_mutex_unlock(&dev->mutex);
-}
-
-static void resolve_finalize(struct vban_udp_set_host_thread_s *ctx, const struct in_addr *addr)
-{
-	pthread_mutex_lock(&ctx->dev->mutex);
-
-	for (struct source_list_s *item = ctx->dev->sources; item; item = item->next) {
-		if (item->resolving != ctx)
-			continue;
-
-		if (addr) {
-			struct in_addr mask = {0};
-			mask.s_addr = 0xFFFFFFFF;
+		// Until a host name is resolved, the previous address is kept.
+		if (!host) {
 			item->addr = *addr;
-			item->mask = mask;
+			item->mask = *mask;
 		}
-		item->resolving = NULL;
+		old_host = item->host;
+		item->host = host;
+		host = NULL;
 		break;
 	}
 
-	pthread_mutex_unlock(&ctx->dev->mutex);
-
-	vban_udp_release(ctx->dev);
-	bfree(ctx);
-}
-
-static void resolve_succeeded(void *data, const struct in_addr *addr)
-{
-	struct vban_udp_set_host_thread_s *ctx = data;
-	resolve_finalize(ctx, addr);
-}
+	pthread_mutex_unlock(&dev->mutex);
 
-static void resolve_failed(void *data)
-{
-	struct vban_udp_set_host_thread_s *ctx = data;
-	resolve_finalize(ctx, NULL);
+	if (old_host)
+		resolve_cache_release(old_host);
+	if (host)
+		resolve_cache_release(host);
 }
 
 void vban_udp_set_host(vban_udp_t *dev, vban_udp_cb_t cb, void *data, const char *host)
@@ -278,36 +234,21 @@ void vban_udp_set_host(vban_udp_t *dev, vban_udp_cb_t cb, void *data, const char
 
 	if (!host || !*host) {
 		blog(LOG_INFO, "host address: %s (accepting everything)", inet_ntoa(addr));
-		vban_udp_set_addr_mask(dev, cb, data, &addr, &mask);
+		vban_udp_set_addr_mask(dev, cb, data, &addr, &mask, NULL);
 		return;
 	}
 
 	if (inet_pton(AF_INET, host, &addr)) {
 		blog(LOG_INFO, "host address: %s", inet_ntoa(addr));
 		mask.s_addr = 0xFFFFFFFF;
-		vban_udp_set_addr_mask(dev, cb, data, &addr, &mask);
+		vban_udp_set_addr_mask(dev, cb, data, &addr, &mask, NULL);
 		return;
 	}
 
-	resolve_thread_t *rt = resolve_thread_create(host);
-	if (!rt)
-		return;
-
-	dev = vban_udp_get_ref(dev);
-	if (!dev) {
-		blog(LOG_ERROR, "vban_udp_set_host: Error: Cannot get reference");
-		resolve_thread_release(rt);
+	resolve_cache_t *rc = resolve_cache_get(host);
+	if (!rc)
 		return;
-	}
-
-	struct vban_udp_set_host_thread_s *ctx = bzalloc(sizeof(struct vban_udp_set_host_thread_s));
-	ctx->dev = dev;
-	mark_resolving(dev, cb, data, ctx);
-
-	resolve_thread_set_callbacks(rt, ctx, resolve_succeeded, resolve_failed);
-
-	blog(LOG_DEBUG, "%p: Resolving '%s'", ctx, host);
-	resolve_thread_start(rt);
 
-	resolve_thread_release(rt);
+	blog(LOG_INFO, "host name: %s", host);
+	vban_udp_set_addr_mask(dev, cb, data, &addr, &mask, rc);
 }
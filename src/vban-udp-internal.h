@@ -11,7 +11,7 @@ struct source_list_s
 {
 	vban_udp_cb_t cb;
 	void *data;
-	struct vban_udp_set_host_thread_s *resolving;
+	struct resolve_cache_s *host; // the address follows the host name if set
 
 	struct source_list_s *next;
 	struct source_list_s **prev_next;
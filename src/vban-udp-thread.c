@@ -21,6 +21,7 @@
 #include <util/threading.h>
 #include "plugin-macros.generated.h"
 #include "vban-udp-internal.h"
+#include "resolve-thread.h"
 #include "socket.h"
 #include <vban.h>
 
@@ -117,13 +118,17 @@ void *vban_udp_thread_main(void *data)
 		if (header->format_SR >= VBAN_SR_MAXNUMBER)
 			continue;
 
-		if ((header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_PCM) {
+		// User codec carries the parity packets for the sources.
+		if ((header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_PCM &&
+		    (header->format_bit & VBAN_CODEC_MASK) != VBAN_CODEC_USER) {
 			blog(LOG_WARNING, "Unsupported VBAN-CODEC: 0x%x", (int)header->format_bit);
 			continue;
 		}
 
 		pthread_mutex_lock(&dev->mutex);
 		for (struct source_list_s *src = dev->sources; src; src = src->next) {
+			if (src->host && resolve_cache_get_addr(src->host, &src->addr))
+				src->mask.s_addr = 0xFFFFFFFF;
 			if ((addr.sin_addr.s_addr & src->mask.s_addr) != (src->addr.s_addr & src->mask.s_addr))
 				continue;
 			if (src->stream_name[0] &&
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <obs-module.h>
+#include "plugin-macros.generated.h"
+#include "wire-ring.h"
+
+#define WIRE_RING_MIN_SIZE 65536
+
+void wire_ring_free(struct wire_ring_s *r)
+{
+	bfree(r->data);
+	r->data = NULL;
+	r->size = r->head = r->len = 0;
+}
+
+static void grow(struct wire_ring_s *r, size_t required)
+{
+	size_t size = r->size ? r->size : WIRE_RING_MIN_SIZE;
+	while (size < required)
+		size *= 2;
+
+	// Stored bytes are moved to the beginning of the new buffer.
+	char *data = bmalloc(size);
+	const char *ptr[2];
+	size_t len[2];
+	wire_ring_peek(r, r->len, ptr, len);
+	if (len[0])
+		memcpy(data, ptr[0], len[0]);
+	if (len[1])
+		memcpy(data + len[0], ptr[1], len[1]);
+
+	bfree(r->data);
+	r->data = data;
+	r->size = size;
+	r->head = 0;
+}
+
+void wire_ring_write(struct wire_ring_s *r, const void *src, size_t n)
+{
+	if (r->len + n > r->size)
+		grow(r, r->len + n);
+
+	size_t tail = (r->head + r->len) % r->size;
+	size_t n1 = r->size - tail < n ? r->size - tail : n;
+	memcpy(r->data + tail, src, n1);
+	if (n > n1)
+		memcpy(r->data, (const char *)src + n1, n - n1);
+	r->len += n;
+}
+
+void wire_ring_peek(const struct wire_ring_s *r, size_t n, const char *ptr[2], size_t len[2])
+{
+	size_t n1 = r->size - r->head < n ? r->size - r->head : n;
+	ptr[0] = r->data + r->head;
+	len[0] = n1;
+	ptr[1] = r->data;
+	len[1] = n - n1;
+}
+
+void wire_ring_consume(struct wire_ring_s *r, size_t n)
+{
+	r->head = r->len > n ? (r->head + n) % r->size : 0;
+	r->len -= n;
+}
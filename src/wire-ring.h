@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Circular byte buffer holding encoded samples in wire format.
+ *
+ * Packets are sent directly from the buffer. A packet that wraps around the
+ * end of the buffer is described by two segments, which are given to the
+ * socket as separate iovecs, so that no payload is copied after encoding.
+ */
+struct wire_ring_s
+{
+	char *data;
+	size_t size;
+	size_t head; // offset of the oldest byte
+	size_t len;  // number of stored bytes
+};
+
+/**
+ * Free the buffer.
+ * @param[in] r  The buffer.
+ */
+void wire_ring_free(struct wire_ring_s *r);
+
+/**
+ * Append bytes. The buffer grows if it does not have room.
+ * @param[in] r    The buffer.
+ * @param[in] src  The bytes to append.
+ * @param[in] n    Number of bytes.
+ *
+ * Bytes released by `wire_ring_consume` may be overwritten, so that packets
+ * referring to them have to be sent before calling this function.
+ */
+void wire_ring_write(struct wire_ring_s *r, const void *src, size_t n);
+
+/**
+ * Get the oldest bytes without removing them.
+ * @param[in] r     The buffer.
+ * @param[in] n     Number of bytes, up to `r->len`.
+ * @param[out] ptr  Pointers to the first and the second segments.
+ * @param[out] len  Lengths of the segments. The second length is 0 unless the bytes wrap around.
+ */
+void wire_ring_peek(const struct wire_ring_s *r, size_t n, const char *ptr[2], size_t len[2]);
+
+/**
+ * Remove the oldest bytes.
+ * @param[in] r  The buffer.
+ * @param[in] n  Number of bytes, up to `r->len`.
+ */
+void wire_ring_consume(struct wire_ring_s *r, size_t n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
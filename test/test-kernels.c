@@ -0,0 +1,282 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vban-encode-simd.h"
+#include "vban-resampler.h"
+
+#define N_MAX 1031
+#define GUARD 32
+#define N_TRIALS 200
+
+static struct vban_encode_kernels ref;
+static struct vban_encode_kernels opt;
+static int failures = 0;
+
+static void check(bool ok, int line, const char *fmt, ...)
+{
+	if (ok)
+		return;
+
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "%s:%d: ", __FILE__, line);
+	vfprintf(stderr, fmt, args);
+	fputc('\n', stderr);
+	va_end(args);
+	failures++;
+}
+
+#define CHECK(cond, ...) check((cond), __LINE__, __VA_ARGS__)
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+	// xorshift32, so that a failure is reproducible
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static float rng_float(float range)
+{
+	return ((float)(rng() >> 8) / (float)(1 << 24) * 2.0f - 1.0f) * range;
+}
+
+/* Mostly odd lengths so that the scalar tail of each vector kernel is exercised. */
+static size_t rng_len(void)
+{
+	return (rng() % N_MAX) | 1;
+}
+
+static void test_quantize(void)
+{
+	static const float scales[] = {128.0f, 32768.0f, 8388608.0f};
+	float src[N_MAX], noise[N_MAX];
+	int32_t a[N_MAX], b[N_MAX];
+
+	for (int t = 0; t < N_TRIALS; t++) {
+		size_t n = rng_len();
+		float scale = scales[t % 3];
+		float max = scale - 1.0f;
+		for (size_t i = 0; i < n; i++) {
+			src[i] = rng_float(1.2f);
+			noise[i] = rng_float(1.0f);
+		}
+		src[rng() % n] = NAN;
+
+		const float *nz = t & 1 ? noise : NULL;
+		ref.quantize(a, src, nz, n, scale, max);
+		opt.quantize(b, src, nz, n, scale, max);
+		CHECK(!memcmp(a, b, n * sizeof(int32_t)), "quantize: mismatch, n=%zu scale=%g", n, scale);
+	}
+}
+
+static void test_interleave(void)
+{
+	int32_t l[N_MAX], r[N_MAX];
+	float fl[N_MAX], fr[N_MAX];
+	uint8_t a[N_MAX * 8 + GUARD], b[N_MAX * 8 + GUARD];
+
+	for (int t = 0; t < N_TRIALS; t++) {
+		size_t n = rng_len();
+		for (size_t i = 0; i < n; i++) {
+			l[i] = (int32_t)rng() >> 8;
+			r[i] = (int32_t)rng() >> 8;
+			fl[i] = rng_float(1.0f);
+			fr[i] = rng_float(1.0f);
+		}
+
+		memset(a, 0xA5, sizeof(a));
+		memset(b, 0xA5, sizeof(b));
+		int32_t l16[N_MAX], r16[N_MAX];
+		for (size_t i = 0; i < n; i++) {
+			l16[i] = l[i] >> 8;
+			r16[i] = r[i] >> 8;
+		}
+		ref.interleave16x2(a, l16, r16, n);
+		opt.interleave16x2(b, l16, r16, n);
+		CHECK(!memcmp(a, b, sizeof(a)), "interleave16x2: mismatch, n=%zu", n);
+
+		ref.interleave24x2(a, l, r, n);
+		opt.interleave24x2(b, l, r, n);
+		CHECK(!memcmp(a, b, sizeof(a)), "interleave24x2: mismatch, n=%zu", n);
+
+		ref.interleave32x2(a, l, r, n);
+		opt.interleave32x2(b, l, r, n);
+		CHECK(!memcmp(a, b, sizeof(a)), "interleave32x2: mismatch, n=%zu", n);
+
+		ref.interleave32x2(a, fl, fr, n);
+		opt.interleave32x2(b, fl, fr, n);
+		CHECK(!memcmp(a, b, sizeof(a)), "interleave32x2: mismatch of float, n=%zu", n);
+	}
+}
+
+static void test_interleave_units(void)
+{
+	static const size_t units[] = {1, 2, 3, 4, 6, 8, 12, 16};
+	static uint8_t src[4][N_MAX * 16];
+	static uint8_t a[N_MAX * 64 + GUARD], b[N_MAX * 64 + GUARD];
+
+	for (size_t k = 0; k < 4; k++) {
+		for (size_t i = 0; i < sizeof(src[k]); i++)
+			src[k][i] = (uint8_t)rng();
+	}
+	const uint8_t *const s[4] = {src[0], src[1], src[2], src[3]};
+
+	for (int t = 0; t < N_TRIALS; t++) {
+		size_t frames = rng_len();
+		size_t unit = units[t % 8];
+		size_t n_src = 1 + rng() % 4;
+
+		memset(a, 0xA5, sizeof(a));
+		memset(b, 0xA5, sizeof(b));
+		ref.interleave_units(a, s, n_src, unit, frames);
+		opt.interleave_units(b, s, n_src, unit, frames);
+		CHECK(!memcmp(a, b, sizeof(a)), "interleave_units: mismatch, n_src=%zu unit=%zu frames=%zu", n_src,
+		      unit, frames);
+	}
+}
+
+static void test_float_kernels(void)
+{
+	static float src[4][N_MAX];
+	float a[N_MAX + GUARD], b[N_MAX + GUARD];
+	const float *const s[4] = {src[0], src[1], src[2], src[3]};
+	float gain[4];
+
+	for (int t = 0; t < N_TRIALS; t++) {
+		size_t n = rng_len();
+		for (size_t k = 0; k < 4; k++) {
+			gain[k] = rng_float(2.0f);
+			for (size_t i = 0; i < n; i++)
+				src[k][i] = rng_float(1.0f);
+		}
+
+		// The order of the additions differs, so the results differ by rounding.
+		float da = ref.dot(src[0], src[1], n);
+		float db = opt.dot(src[0], src[1], n);
+		CHECK(fabsf(da - db) <= 1e-5f * (float)n, "dot: %g and %g, n=%zu", da, db, n);
+
+		size_t n_src = t % 5;
+		memset(a, 0, sizeof(a));
+		memset(b, 0, sizeof(b));
+		ref.mix(a, s, gain, n_src, n);
+		opt.mix(b, s, gain, n_src, n);
+		for (size_t i = 0; i < n + GUARD; i++)
+			CHECK(fabsf(a[i] - b[i]) <= 1e-5f, "mix: %g and %g at %zu, n_src=%zu n=%zu", a[i], b[i], i,
+			      n_src, n);
+
+		float pa = ref.peak(src[0], n);
+		float pb = opt.peak(src[0], n);
+		CHECK(pa == pb, "peak: %g and %g, n=%zu", pa, pb, n);
+
+		src[0][rng() % n] = NAN;
+		pb = opt.peak(src[0], n);
+		CHECK(isinf(pb), "peak: %g for NaN, n=%zu", pb, n);
+	}
+}
+
+static void test_pack(const char *name, vban_pack_fn pack_ref, vban_pack_fn pack_opt, vban_unpack_fn unpack_ref,
+		      vban_unpack_fn unpack_opt, unsigned bits)
+{
+	int16_t src[N_MAX], a[N_MAX], b[N_MAX];
+	uint8_t pa[N_MAX * 2 + GUARD], pb[N_MAX * 2 + GUARD];
+
+	for (int t = 0; t < N_TRIALS; t++) {
+		size_t n = t < 16 ? (size_t)t : rng_len();
+		for (size_t i = 0; i < n; i++)
+			src[i] = (int16_t)((int32_t)rng() >> (32 - bits));
+
+		memset(pa, 0xA5, sizeof(pa));
+		memset(pb, 0xA5, sizeof(pb));
+		pack_ref(pa, src, n);
+		pack_opt(pb, src, n);
+		CHECK(!memcmp(pa, pb, sizeof(pa)), "pack%u: mismatch, n=%zu", bits, n);
+
+		memset(a, 0, sizeof(a));
+		memset(b, 0, sizeof(b));
+		unpack_ref(a, pa, n);
+		unpack_opt(b, pa, n);
+		CHECK(!memcmp(a, b, sizeof(a)), "unpack%u: mismatch, n=%zu", bits, n);
+
+		// Round trip: the samples come back shifted to the full scale.
+		for (size_t i = 0; i < n; i++) {
+			if (b[i] != (int16_t)(src[i] * (1 << (16 - bits)))) {
+				CHECK(false, "%s: %d became %d at %zu, n=%zu", name, src[i], b[i], i, n);
+				break;
+			}
+		}
+	}
+}
+
+static void test_resampler(uint32_t rate_in, uint32_t rate_out, enum vban_resampler_quality quality)
+{
+	vban_resampler_t *r = vban_resampler_create(rate_in, rate_out, 1, quality, opt.dot);
+	CHECK(r, "resampler: %u -> %u Hz cannot be created", rate_in, rate_out);
+	if (!r)
+		return;
+
+	// The impulse comes out at the group delay and the DC gain is unity after the filter is filled.
+	const uint32_t frames = rate_in / 10;
+	float *in = calloc(frames, sizeof(float));
+	in[0] = 1.0f;
+	const float *out;
+	uint32_t n = vban_resampler_process(r, &out, (const float *const *)&in, frames);
+	CHECK(n + 2 >= (uint64_t)frames * rate_out / rate_in, "resampler: %u outputs for %u inputs", n, frames);
+
+	size_t peak = 0;
+	for (size_t i = 1; i < n; i++) {
+		if (fabsf(out[i]) > fabsf(out[peak]))
+			peak = i;
+	}
+	double delay = (double)vban_resampler_delay_ns(r) * 1e-9 * rate_out;
+	CHECK(fabs((double)peak - delay) <= 1.0, "resampler: %u -> %u Hz, impulse at %zu, delay %.2f", rate_in,
+	      rate_out, peak, delay);
+
+	for (uint32_t i = 0; i < frames; i++)
+		in[i] = 0.5f;
+	vban_resampler_process(r, &out, (const float *const *)&in, frames);
+	n = vban_resampler_process(r, &out, (const float *const *)&in, frames);
+	for (uint32_t i = 0; i < n; i++) {
+		if (fabsf(out[i] - 0.5f) > 1e-4f) {
+			CHECK(false, "resampler: %u -> %u Hz, DC became %g at %u", rate_in, rate_out, out[i], i);
+			break;
+		}
+	}
+
+	free(in);
+	vban_resampler_destroy(r);
+}
+
+int main(void)
+{
+	vban_encode_kernels_portable(&ref);
+	vban_encode_kernels_select(&opt);
+	printf("Comparing %s kernels with %s kernels\n", opt.name, ref.name);
+
+	test_quantize();
+	test_interleave();
+	test_interleave_units();
+	test_float_kernels();
+	test_pack("pack12", ref.pack12, opt.pack12, ref.unpack12, opt.unpack12, 12);
+	test_pack("pack10", ref.pack10, opt.pack10, ref.unpack10, opt.unpack10, 10);
+
+	test_resampler(48000, 44100, VBAN_RESAMPLER_BALANCED);
+	test_resampler(44100, 48000, VBAN_RESAMPLER_HIGH_QUALITY);
+	test_resampler(48000, 96000, VBAN_RESAMPLER_LOW_LATENCY);
+	test_resampler(96000, 48000, VBAN_RESAMPLER_BALANCED);
+
+	if (failures) {
+		fprintf(stderr, "%d failures\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}